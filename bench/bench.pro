@@ -0,0 +1,49 @@
+QT       += core gui
+
+TARGET = qt-ponies-bench
+OBJECTS_DIR = bin
+MOC_DIR = moc
+TEMPLATE = app
+CONFIG += console
+CONFIG -= app_bundle
+
+QMAKE_CXXFLAGS += -std=c++0x -Wextra -O2 -ftree-vectorize
+
+INCLUDEPATH += ../src
+
+SOURCES += main.cpp \
+    ../src/pony.cpp \
+    ../src/behavior.cpp \
+    ../src/effect.cpp \
+    ../src/speak.cpp \
+    ../src/csv_parser.cpp \
+    ../src/interaction.cpp \
+    ../src/ponytemplate.cpp \
+    ../src/runtimeconfig.cpp \
+    ../src/simulation.cpp \
+    ../src/movementkernel.cpp \
+    ../src/timerwheel.cpp \
+    ../src/screenlayout.cpp \
+    ../src/animation.cpp \
+    ../src/mirrorcache.cpp \
+    ../src/ponydatabase.cpp
+
+HEADERS += \
+    ../src/pony.h \
+    ../src/behavior.h \
+    ../src/effect.h \
+    ../src/speak.h \
+    ../src/csv_parser.h \
+    ../src/interaction.h \
+    ../src/ponytemplate.h \
+    ../src/runtimeconfig.h \
+    ../src/spatialgrid.h \
+    ../src/aliastable.h \
+    ../src/random.h \
+    ../src/simulation.h \
+    ../src/movementkernel.h \
+    ../src/timerwheel.h \
+    ../src/screenlayout.h \
+    ../src/animation.h \
+    ../src/mirrorcache.h \
+    ../src/ponydatabase.h
@@ -0,0 +1,541 @@
+/*
+ * Qt-ponies - ponies on the desktop
+ * Copyright (C) 2012 mysha
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Runs the simulation core without any windows on a virtual screen, and reports
+// how the cost of a tick grows with the number of ponies. The cost per pony of a whole tick
+// and of the movement pass alone should stay flat as the number of ponies grows.
+//
+// It also shows the CPU time per simulated second at several update rates, with the distance
+// the ponies cover, which should not depend on the rate, and compares the cost of selecting a
+// random behavior with the alias table against the roulette-wheel scan it replaced, and the cost
+// per tick of a hundred ponies running the fastest spawning effects of the pack.
+// Finally it decodes every animation of every pony and compares the memory used by the frames
+// stored as ARGB and as palette indices, and how much is saved by decoding identical files once.
+//
+// Usage: qt-ponies-bench [pony directory] [ticks] [seed]
+
+#include <QCoreApplication>
+#include <QStringList>
+#include <QDir>
+#include <QFile>
+#include <QRect>
+#include <QPointF>
+#include <QImage>
+#include <QDebug>
+#include <QHash>
+#include <QCryptographicHash>
+
+#include <vector>
+#include <algorithm>
+#include <random>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+
+#include "csv_parser.h"
+#include "behavior.h"
+#include "effect.h"
+#include "speak.h"
+#include "runtimeconfig.h"
+#include "simulation.h"
+#include "aliastable.h"
+#include "random.h"
+#include "pony.h"
+#include "animation.h"
+
+// Same as the update timer of the application
+static const int64_t tick_interval = 30;
+
+// Ticks run before measuring, so every pony has started its first behaviors
+static const int warmup_ticks = 100;
+
+// Only show errors, warnings about pony data would be printed for every pony
+void handle_message(QtMsgType type, const char *msg)
+{
+    if(type == QtCriticalMsg || type == QtFatalMsg) {
+        std::fprintf(stderr, "%s\n", msg);
+    }
+    if(type == QtFatalMsg) {
+        std::abort();
+    }
+}
+
+static double percentile(const std::vector<double> &sorted, double p)
+{
+    if(sorted.empty()) return 0;
+    size_t index = static_cast<size_t>(p * (sorted.size() - 1) + 0.5);
+    return sorted[index];
+}
+
+static double elapsed_ns(std::chrono::high_resolution_clock::time_point start, std::chrono::high_resolution_clock::time_point end)
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+}
+
+// CPU time and distance covered by the ponies in one simulated minute, at several update rates
+static void bench_update_rates(const QStringList &names, const QRect &screen, uint64_t seed)
+{
+    const int rates[] = { 10, 20, 33, 60, 120 };
+    const int count = 100;
+    const int64_t duration = 60000;
+
+    std::printf("\n%8s %10s %14s %14s\n", "rate Hz", "updates", "cpu ms/s", "pixels/s/pony");
+
+    for(int rate: rates) {
+        const int64_t interval = 1000 / rate;
+
+        int64_t time = 0;
+        Simulation simulation(time, ScreenLayout(std::vector<QRect>(1, screen), std::vector<QRect>(1, screen), 0), seed);
+
+        for(int i = 0; i < count; i++) {
+            try {
+                simulation.add_pony(names[i % names.size()]);
+            }catch (std::exception &e) {
+            }
+        }
+
+        std::vector<QPointF> positions;
+        for(auto &i: simulation.ponies) {
+            positions.push_back(QPointF(i->x_pos(), i->y_pos()));
+        }
+
+        double distance = 0;
+        double cpu_ns = 0;
+        int updates = 0;
+
+        while(time < duration) {
+            time += interval;
+
+            auto start = std::chrono::high_resolution_clock::now();
+            simulation.update(time);
+            cpu_ns += elapsed_ns(start, std::chrono::high_resolution_clock::now());
+            updates++;
+
+            int j = 0;
+            for(auto &i: simulation.ponies) {
+                const float dx = i->x_pos() - positions[j].x();
+                const float dy = i->y_pos() - positions[j].y();
+                distance += std::sqrt(dx*dx + dy*dy);
+                positions[j] = QPointF(i->x_pos(), i->y_pos());
+                j++;
+            }
+        }
+
+        const double seconds = time / 1000.0;
+        const int ponies = std::max<int>(simulation.ponies.size(), 1);
+
+        std::printf("%8d %10d %14.3f %14.1f\n", rate, updates, cpu_ns / 1e6 / seconds, distance / seconds / ponies);
+    }
+}
+
+// Cost per tick of ponies running the effects of the pack that spawn the fastest, driven by the
+// Simulation as in the application, against the same ponies with effects disabled.
+// Each pony is put back into the behavior starting the effect whenever it leaves it.
+static void bench_effect_expiry(const QStringList &names, const QRect &screen, uint64_t seed)
+{
+    struct Case {
+        const char *pony;
+        const char *behavior;
+    };
+    // Rainbow trail every 10 msec lasting 1.5 sec, smoke trail every 20 msec lasting 1 sec,
+    // apples every 500 msec lasting 3.3 sec
+    const Case cases[] = { { "Filly Rainbow Dash", "RainBoom5" }, { "Spitfire", "flight" }, { "Applejack", "gallop" } };
+    const int count = 100;
+
+    // One simulated minute
+    const int64_t run_time = 60000;
+    const int ticks = run_time / tick_interval;
+
+    const RuntimeSettings settings = RuntimeConfig::settings();
+
+    std::printf("\n%20s %12s %12s %12s %12s\n", "pony", "behavior", "instances", "effects ns", "no effects ns");
+
+    for(const Case &c: cases) {
+        if(!names.contains(c.pony)) continue;
+
+        double tick_ns[2] = { 0, 0 };
+        double instances = 0;
+
+        for(int effects = 1; effects >= 0; effects--) {
+            RuntimeSettings changed = settings;
+            changed.effects_enabled = effects != 0;
+            RuntimeConfig::instance().publish(changed);
+
+            int64_t time = 0;
+            Simulation simulation(time, ScreenLayout(std::vector<QRect>(1, screen), std::vector<QRect>(1, screen), 0), seed);
+
+            for(int i = 0; i < count; i++) {
+                try {
+                    simulation.add_pony(c.pony);
+                }catch (std::exception &e) {
+                }
+            }
+
+            for(int i = 0; i < ticks; i++) {
+                for(auto &p: simulation.ponies) {
+                    if(p->current_behavior == nullptr || p->current_behavior->name != c.behavior) {
+                        p->change_behavior_to(c.behavior);
+                    }
+                }
+
+                time += tick_interval;
+                auto start = std::chrono::high_resolution_clock::now();
+                simulation.update(time);
+                tick_ns[effects] += elapsed_ns(start, std::chrono::high_resolution_clock::now());
+
+                if(effects) {
+                    for(auto &p: simulation.ponies) {
+                        for(auto &e: p->effects) {
+                            instances += e.instances.size();
+                        }
+                    }
+                }
+            }
+        }
+
+        std::printf("%20s %12s %12.1f %12.1f %12.1f\n", c.pony, c.behavior, instances / ticks,
+                    tick_ns[1] / ticks, tick_ns[0] / ticks);
+    }
+
+    RuntimeConfig::instance().publish(settings);
+}
+
+// Memory used by the frames of every animation in the pack when they are kept as ARGB and as
+// palette indices, with the time to expand an indexed frame to ARGB when it is drawn.
+// Also the area that is repainted for a frame: the whole image, the part of the animation that is
+// drawn in any frame (the size of the windows) and the part of the frame itself (in overlay mode).
+static void bench_frame_memory(const QString &pony_directory, const QStringList &names)
+{
+    struct Usage {
+        QString name;
+        size_t argb_bytes;
+        size_t indexed_bytes;
+    };
+    std::vector<Usage> ponies;
+
+    int files = 0;
+    int frames = 0;
+    int indexed_frames = 0;
+    double expand_ns = 0;
+    double expanded_pixels = 0;
+    QImage buffer;
+
+    double image_area = 0;
+    double animation_area = 0;
+    double frame_area = 0;
+
+    for(auto &name: names) {
+        QDir dir(QString("%1/%2").arg(pony_directory, name));
+        dir.setNameFilters(QStringList() << "*.gif" << "*.GIF");
+
+        Usage usage = { name, 0, 0 };
+        for(auto &file: dir.entryList()) {
+            const QString path = dir.absoluteFilePath(file);
+            AnimationFrames argb(path, false);
+            AnimationFrames indexed(path, true);
+
+            files++;
+            frames += indexed.frame_count();
+            usage.argb_bytes += argb.bytes;
+            usage.indexed_bytes += indexed.bytes;
+
+            for(int i = 0; i < argb.frame_count(); i++) {
+                const QRect bounds = argb.frame_bounds(i);
+                image_area += static_cast<double>(argb.image(i).width()) * argb.image(i).height();
+                animation_area += static_cast<double>(argb.bounds.width()) * argb.bounds.height();
+                frame_area += static_cast<double>(bounds.width()) * bounds.height();
+            }
+
+            for(int i = 0; i < indexed.frame_count(); i++) {
+                if(!indexed.is_indexed(i)) continue;
+                indexed_frames++;
+
+                auto start = std::chrono::high_resolution_clock::now();
+                indexed.expand(i, buffer);
+                auto end = std::chrono::high_resolution_clock::now();
+
+                expand_ns += elapsed_ns(start, end);
+                expanded_pixels += static_cast<double>(buffer.width()) * buffer.height();
+            }
+        }
+        ponies.push_back(usage);
+    }
+
+    size_t argb_bytes = 0;
+    size_t indexed_bytes = 0;
+    for(auto &i: ponies) {
+        argb_bytes += i.argb_bytes;
+        indexed_bytes += i.indexed_bytes;
+    }
+
+    const double mb = 1024.0 * 1024.0;
+
+    std::printf("\n%8s %8s %10s %12s %12s %8s %14s\n", "files", "frames", "indexed", "argb MB", "indexed MB", "ratio", "expand ns/px");
+    std::printf("%8d %8d %10d %12.1f %12.1f %8.2f %14.2f\n", files, frames, indexed_frames, argb_bytes / mb, indexed_bytes / mb,
+                indexed_bytes > 0 ? static_cast<double>(argb_bytes) / indexed_bytes : 0.0,
+                expanded_pixels > 0 ? expand_ns / expanded_pixels : 0.0);
+
+    // The ponies with the largest animations gain the most
+    std::sort(ponies.begin(), ponies.end(), [](const Usage &a, const Usage &b){ return a.argb_bytes > b.argb_bytes; });
+    if(ponies.size() > 5) ponies.resize(5);
+
+    std::printf("\n%30s %12s %12s\n", "pony", "argb MB", "indexed MB");
+    for(auto &i: ponies) {
+        std::printf("%30s %12.1f %12.1f\n", i.name.toUtf8().constData(), i.argb_bytes / mb, i.indexed_bytes / mb);
+    }
+
+    // Average pixels per frame
+    const double frame_count = std::max(frames, 1);
+    std::printf("\n%14s %14s %14s\n", "image px", "animation px", "frame px");
+    std::printf("%14.0f %14.0f %14.0f\n", image_area / frame_count, animation_area / frame_count, frame_area / frame_count);
+}
+
+// Files in the pack that are identical to a file in another (or the same) pony directory,
+// and the memory saved by sharing the frames of identical files in the AnimationCache
+static void bench_duplicate_files(const QString &pony_directory, const QStringList &names)
+{
+    struct Content {
+        QString first;  // First file with these contents
+        int files;
+        qint64 file_bytes;
+        size_t frame_bytes;
+    };
+    QHash<QByteArray, Content> contents;
+
+    int files = 0;
+    qint64 saved_file_bytes = 0;
+    size_t saved_frame_bytes = 0;
+
+    for(auto &name: names) {
+        QDir dir(QString("%1/%2").arg(pony_directory, name));
+        dir.setNameFilters(QStringList() << "*.gif" << "*.GIF");
+
+        for(auto &file: dir.entryList()) {
+            QFile f(dir.absoluteFilePath(file));
+            if(!f.open(QIODevice::ReadOnly)) continue;
+            const QByteArray data = f.readAll();
+            const QByteArray key = QCryptographicHash::hash(data, QCryptographicHash::Sha1);
+            files++;
+
+            auto found = contents.find(key);
+            if(found != contents.end()) {
+                found->files++;
+                saved_file_bytes += found->file_bytes;
+                saved_frame_bytes += found->frame_bytes;
+                continue;
+            }
+
+            Content content;
+            content.first = QString("%1/%2").arg(name, file);
+            content.files = 1;
+            content.file_bytes = data.size();
+            content.frame_bytes = AnimationFrames(dir.absoluteFilePath(file), false).bytes;
+            contents.insert(key, content);
+        }
+    }
+
+    const double mb = 1024.0 * 1024.0;
+
+    std::printf("\n%8s %8s %12s %16s\n", "files", "unique", "file MB saved", "decoded MB saved");
+    std::printf("%8d %8d %12.1f %16.1f\n", files, contents.size(), saved_file_bytes / mb, saved_frame_bytes / mb);
+
+    // The files shared by the most ponies
+    std::vector<Content> shared;
+    for(auto &i: contents) {
+        if(i.files > 1) shared.push_back(i);
+    }
+    std::sort(shared.begin(), shared.end(), [](const Content &a, const Content &b){
+        return (a.files - 1) * a.frame_bytes > (b.files - 1) * b.frame_bytes;
+    });
+    if(shared.size() > 5) shared.resize(5);
+
+    std::printf("\n%50s %8s %16s\n", "file", "copies", "decoded MB saved");
+    for(auto &i: shared) {
+        std::printf("%50s %8d %16.1f\n", i.first.toUtf8().constData(), i.files, (i.files - 1) * i.frame_bytes / mb);
+    }
+}
+
+// Time to select one of 'count' behaviors with random probabilities
+static void bench_behavior_selection()
+{
+    const int counts[] = { 10, 100, 1000 };
+    const int samples = 1000000;
+
+    Random gen(1);
+    std::uniform_real_distribution<float> dis(0, 1);
+
+    std::printf("\n%10s %12s %12s\n", "behaviors", "scan ns", "alias ns");
+
+    // Keeps the selections from being optimized away
+    long long checksum = 0;
+
+    for(int count: counts) {
+        std::vector<float> weights(count);
+        float total = 0;
+        for(auto &i: weights) {
+            i = dis(gen);
+            total += i;
+        }
+        // The scan went over behaviors sorted by probability
+        std::sort(weights.begin(), weights.end());
+
+        AliasTable table(weights);
+
+        auto scan_start = std::chrono::high_resolution_clock::now();
+        for(int i = 0; i < samples; i++) {
+            float rnd = dis(gen) * total;
+            float sum = 0;
+            int selected = count - 1;
+            for(int j = 0; j < count; j++) {
+                sum += weights[j];
+                if(rnd <= sum) {
+                    selected = j;
+                    break;
+                }
+            }
+            checksum += selected;
+        }
+        auto scan_end = std::chrono::high_resolution_clock::now();
+
+        for(int i = 0; i < samples; i++) {
+            checksum += table.sample(gen);
+        }
+        auto alias_end = std::chrono::high_resolution_clock::now();
+
+        std::printf("%10d %12.1f %12.1f\n", count, elapsed_ns(scan_start, scan_end) / samples, elapsed_ns(scan_end, alias_end) / samples);
+    }
+
+    if(checksum == -1) std::printf("\n");
+}
+
+int main(int argc, char *argv[])
+{
+    CSVParser::AddParseTypes("Behavior", Behavior::OptionTypes);
+    CSVParser::AddParseTypes("Effect", Effect::OptionTypes);
+    CSVParser::AddParseTypes("Speak", Speak::OptionTypes);
+
+    // Needed for the image format plugins
+    QCoreApplication app(argc, argv);
+    qInstallMsgHandler(handle_message);
+
+    QString pony_directory = argc > 1 ? QString(argv[1]) : QString("../desktop-ponies");
+    int ticks = argc > 2 ? std::atoi(argv[2]) : 1000;
+    if(ticks <= 0) ticks = 1000;
+    // The same seed gives the same simulation, so runs can be compared
+    uint64_t seed = argc > 3 ? std::strtoull(argv[3], nullptr, 10) : 1;
+
+    // Defaults of the configuration window, without sound
+    RuntimeSettings settings;
+    settings.pony_directory = pony_directory;
+    settings.always_on_top = true;
+    settings.bypass_wm = false;
+    settings.interactions_enabled = true;
+    settings.effects_enabled = true;
+    settings.debug = false;
+    settings.animation_cache_size = 64;
+    settings.indexed_frames = false;
+    settings.update_rate = 33;
+    settings.speech_enabled = true;
+    settings.speech_probability = 50;
+    settings.speech_duration = 2000;
+    settings.sound_enabled = false;
+    RuntimeConfig::instance().publish(settings);
+
+    QDir dir(pony_directory);
+    dir.setFilter(QDir::Dirs | QDir::NoDotAndDotDot);
+
+    QStringList names;
+    for(auto &i: dir.entryList()) {
+        if(QFile::exists(QString("%1/%2/pony.ini").arg(pony_directory, i))) {
+            names.push_back(i);
+        }
+    }
+
+    if(names.isEmpty()) {
+        qCritical() << "No ponies found in" << pony_directory;
+        return 1;
+    }
+
+    const QRect screen(0, 0, 1920, 1080);
+    const int counts[] = { 10, 100, 1000, 10000 };
+
+    std::printf("%d pony types, %d ticks of %d ms on a %dx%d virtual screen\n\n",
+                names.size(), ticks, static_cast<int>(tick_interval), screen.width(), screen.height());
+    std::printf("%8s %12s %10s %10s %10s %10s %12s %12s\n", "ponies", "ticks/s", "p50 us", "p90 us", "p99 us", "max us",
+                "tick ns/pony", "move ns/pony");
+
+    for(int count: counts) {
+        int64_t time = 0;
+        Simulation simulation(time, ScreenLayout(std::vector<QRect>(1, screen), std::vector<QRect>(1, screen), 0), seed);
+        simulation.load_interactions(pony_directory);
+
+        // Use every pony type in turn
+        for(int i = 0; i < count; i++) {
+            try {
+                simulation.add_pony(names[i % names.size()]);
+            }catch (std::exception &e) {
+            }
+        }
+
+        for(int i = 0; i < warmup_ticks; i++) {
+            time += tick_interval;
+            simulation.update(time);
+        }
+
+        std::vector<double> latencies;
+        latencies.reserve(ticks);
+
+        auto run_start = std::chrono::high_resolution_clock::now();
+        for(int i = 0; i < ticks; i++) {
+            time += tick_interval;
+
+            auto tick_start = std::chrono::high_resolution_clock::now();
+            simulation.update(time);
+            auto tick_end = std::chrono::high_resolution_clock::now();
+
+            latencies.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(tick_end - tick_start).count() / 1000.0);
+        }
+        auto run_end = std::chrono::high_resolution_clock::now();
+
+        double seconds = std::chrono::duration_cast<std::chrono::nanoseconds>(run_end - run_start).count() / 1e9;
+        std::sort(latencies.begin(), latencies.end());
+
+        // The movement pass on its own, with the behaviors of the last tick
+        auto move_start = std::chrono::high_resolution_clock::now();
+        for(int i = 0; i < ticks; i++) {
+            simulation.movement_kernel.update(1.0f);
+        }
+        auto move_end = std::chrono::high_resolution_clock::now();
+        double move_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(move_end - move_start).count() / static_cast<double>(ticks);
+
+        const int ponies = std::max<int>(simulation.ponies.size(), 1);
+
+        std::printf("%8d %12.1f %10.1f %10.1f %10.1f %10.1f %12.1f %12.1f\n", static_cast<int>(simulation.ponies.size()), ticks / seconds,
+                    percentile(latencies, 0.50), percentile(latencies, 0.90), percentile(latencies, 0.99), latencies.back(),
+                    percentile(latencies, 0.50) * 1000.0 / ponies, move_ns / ponies);
+    }
+
+    bench_update_rates(names, screen, seed);
+    bench_behavior_selection();
+    bench_effect_expiry(names, screen, seed);
+    bench_frame_memory(pony_directory, names);
+    bench_duplicate_files(pony_directory, names);
+
+    return 0;
+}
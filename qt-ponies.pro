@@ -15,7 +15,7 @@ UI_DIR = src/ui
 RCC_DIR = src/rcc
 TEMPLATE = app
 
-QMAKE_CXXFLAGS += -std=c++0x -Wextra -flto
+QMAKE_CXXFLAGS += -std=c++0x -Wextra -flto -ftree-vectorize
 
 unix:!macx {
     LIBS += -lX11 -lXfixes
@@ -29,7 +29,19 @@ SOURCES += src/main.cpp \
     src/configwindow.cpp \
     src/csv_parser.cpp \
     src/interaction.cpp \
-    src/debugwindow.cpp
+    src/debugwindow.cpp \
+    src/animation.cpp \
+    src/ponytemplate.cpp \
+    src/overlay.cpp \
+    src/runtimeconfig.cpp \
+    src/simulation.cpp \
+    src/movementkernel.cpp \
+    src/timerwheel.cpp \
+    src/screenlayout.cpp \
+    src/ponydatabase.cpp \
+    src/mirrorcache.cpp \
+    src/ponyloader.cpp \
+    src/ponywindow.cpp
 
 HEADERS  += \
     src/pony.h \
@@ -39,7 +51,22 @@ HEADERS  += \
     src/configwindow.h \
     src/csv_parser.h \
     src/interaction.h \
-    src/debugwindow.h
+    src/debugwindow.h \
+    src/animation.h \
+    src/ponytemplate.h \
+    src/overlay.h \
+    src/spatialgrid.h \
+    src/aliastable.h \
+    src/random.h \
+    src/runtimeconfig.h \
+    src/simulation.h \
+    src/movementkernel.h \
+    src/timerwheel.h \
+    src/screenlayout.h \
+    src/ponydatabase.h \
+    src/mirrorcache.h \
+    src/ponyloader.h \
+    src/ponywindow.h
 
 FORMS += \
     src/configwindow.ui \
@@ -0,0 +1,123 @@
+/*
+ * Qt-ponies - ponies on the desktop
+ * Copyright (C) 2012 mysha
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ALIASTABLE_H
+#define ALIASTABLE_H
+
+#include <vector>
+#include <random>
+
+// Selects an index with probability proportional to its weight in constant time,
+// using Vose's alias method. Building the table is linear in the number of weights,
+// so build it once and build it again only when the weights change.
+class AliasTable
+{
+public:
+    AliasTable()
+    {
+    }
+
+    explicit AliasTable(const std::vector<float> &weights)
+    {
+        build(weights);
+    }
+
+    // Weights do not have to add up to 1. Items with no weight are never selected,
+    // unless every weight is zero, then every item is equally likely.
+    void build(const std::vector<float> &weights)
+    {
+        const int n = weights.size();
+        probability.assign(n, 1.0f);
+        alias.resize(n);
+        for(int i = 0; i < n; i++) {
+            alias[i] = i;
+        }
+
+        double total = 0;
+        for(float w: weights) {
+            if(w > 0) total += w;
+        }
+        if(n == 0 || total <= 0) return;
+
+        // Scale the weights so their average is 1, then pair every item below average
+        // with one above it, which fills the rest of its column
+        std::vector<double> scaled(n);
+        std::vector<int> small;
+        std::vector<int> large;
+        for(int i = 0; i < n; i++) {
+            scaled[i] = (weights[i] > 0 ? weights[i] : 0) * n / total;
+            if(scaled[i] < 1.0) {
+                small.push_back(i);
+            }else{
+                large.push_back(i);
+            }
+        }
+
+        while(!small.empty() && !large.empty()) {
+            const int s = small.back();
+            small.pop_back();
+            const int l = large.back();
+            large.pop_back();
+
+            probability[s] = scaled[s];
+            alias[s] = l;
+
+            scaled[l] = (scaled[l] + scaled[s]) - 1.0;
+            if(scaled[l] < 1.0) {
+                small.push_back(l);
+            }else{
+                large.push_back(l);
+            }
+        }
+
+        // Whatever is left fills its whole column, up to rounding errors
+        for(int i: large) {
+            probability[i] = 1.0f;
+        }
+        for(int i: small) {
+            probability[i] = 1.0f;
+        }
+    }
+
+    int size() const
+    {
+        return probability.size();
+    }
+
+    bool empty() const
+    {
+        return probability.empty();
+    }
+
+    // The table must not be empty
+    template <typename Generator>
+    int sample(Generator &gen) const
+    {
+        std::uniform_int_distribution<int> column(0, probability.size() - 1);
+        std::uniform_real_distribution<float> coin(0.0f, 1.0f);
+
+        const int i = column(gen);
+        return coin(gen) < probability[i] ? i : alias[i];
+    }
+
+private:
+    std::vector<float> probability;
+    std::vector<int> alias;
+};
+
+#endif // ALIASTABLE_H
@@ -0,0 +1,937 @@
+/*
+ * Qt-ponies - ponies on the desktop
+ * Copyright (C) 2012 mysha
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <QImageReader>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QBuffer>
+#include <QCryptographicHash>
+#include <QMutexLocker>
+#include <QMetaObject>
+#include <QDebug>
+#include <QtConcurrentRun>
+
+#include <algorithm>
+#include <limits>
+#include <iterator>
+#include <unordered_map>
+
+#include "mirrorcache.h"
+#include "animation.h"
+
+// GIFs with no delay set are shown at 10 frames per second, like browsers do
+static const int default_frame_delay = 100;
+
+AnimationFrames::AnimationFrames()
+    : bytes(0)
+{
+}
+
+AnimationFrames::AnimationFrames(const QString &path, bool indexed)
+    : path(path), bytes(0)
+{
+    QImageReader reader(path);
+    decode(reader, indexed);
+}
+
+AnimationFrames::AnimationFrames(const QString &path, const QByteArray &data, bool indexed)
+    : path(path), bytes(0)
+{
+    QBuffer buffer;
+    buffer.setData(data);
+    buffer.open(QIODevice::ReadOnly);
+
+    QImageReader reader(&buffer);
+    decode(reader, indexed);
+}
+
+void AnimationFrames::decode(QImageReader &reader, bool indexed)
+{
+    while(reader.canRead()) {
+        QImage image;
+        if(!reader.read(&image)) break;
+
+        // Premultiplied ARGB is the fastest format to draw onto translucent windows
+        QImage argb = image.convertToFormat(QImage::Format_ARGB32_Premultiplied);
+        size = size.expandedTo(argb.size());
+
+        Frame frame;
+        if(indexed && make_indexed(argb, frame)) {
+            frame.bounds = indexed_bounds(frame);
+            bytes += frame.palette.size() * sizeof(uint32_t) + frame.indices.size()
+                   + frame.runs.size() * sizeof(Run) + frame.rows.size() * sizeof(uint32_t);
+        }else{
+            frame = Frame();
+            frame.image = argb;
+            frame.size = argb.size();
+            frame.bounds = opaque_bounds(argb);
+            bytes += argb.byteCount();
+        }
+        bounds |= frame.bounds;
+        frames.push_back(std::move(frame));
+
+        int delay = reader.nextImageDelay();
+        delays.push_back(delay > 0 ? delay : default_frame_delay);
+    }
+
+    // Nothing is drawn, use the whole image rather than an empty window
+    if(bounds.isEmpty()) {
+        bounds = QRect(QPoint(0, 0), size);
+    }
+}
+
+AnimationFrames::AnimationFrames(const std::shared_ptr<const AnimationFrames> &source, const QString &path)
+    : path(path), delays(source->delays), size(source->size), bounds(flipped(source->bounds, source->size.width())), bytes(0), source(source)
+{
+}
+
+std::shared_ptr<const AnimationFrames> AnimationFrames::mirror(const std::shared_ptr<const AnimationFrames> &source, const QString &path)
+{
+    // The mirror of a mirror are the original frames, which are still alive
+    if(source->source) return source->source;
+
+    return std::make_shared<AnimationFrames>(source, path);
+}
+
+// Fully transparent pixels are 0 once premultiplied. Each row is first OR-ed together, which the
+// compiler vectorizes, only the rows that are not empty are searched for their first and last pixel.
+QRect AnimationFrames::opaque_bounds(const QImage &image)
+{
+    const int width = image.width();
+    int left = width;
+    int right = -1;
+    int top = -1;
+    int bottom = -1;
+
+    for(int y = 0; y < image.height(); y++) {
+        const uint32_t *line = reinterpret_cast<const uint32_t*>(image.constScanLine(y));
+
+        uint32_t any = 0;
+        for(int x = 0; x < width; x++) {
+            any |= line[x];
+        }
+        if(any == 0) continue;
+
+        if(top == -1) top = y;
+        bottom = y;
+
+        int first = 0;
+        while(line[first] == 0) first++;
+        int last = width - 1;
+        while(line[last] == 0) last--;
+
+        left = std::min(left, first);
+        right = std::max(right, last);
+    }
+
+    if(top == -1) return QRect();
+    return QRect(QPoint(left, top), QPoint(right, bottom));
+}
+
+QRect AnimationFrames::indexed_bounds(const Frame &frame)
+{
+    int left = frame.size.width();
+    int right = -1;
+    int top = -1;
+    int bottom = -1;
+
+    for(int y = 0; y < frame.size.height(); y++) {
+        if(frame.rows[y] == frame.rows[y + 1]) continue;
+
+        if(top == -1) top = y;
+        bottom = y;
+
+        // Runs are in order
+        const Run &first = frame.runs[frame.rows[y]];
+        const Run &last = frame.runs[frame.rows[y + 1] - 1];
+        left = std::min<int>(left, first.x);
+        right = std::max<int>(right, last.x + last.length - 1);
+    }
+
+    if(top == -1) return QRect();
+    return QRect(QPoint(left, top), QPoint(right, bottom));
+}
+
+QRect AnimationFrames::flipped(const QRect &bounds, int width)
+{
+    if(bounds.isEmpty()) return bounds;
+    return QRect(width - 1 - bounds.right(), bounds.top(), bounds.width(), bounds.height());
+}
+
+// Fails if the frame has more than 256 colors. GIF frames drawn over the previous frame can have more.
+bool AnimationFrames::make_indexed(const QImage &image, Frame &frame)
+{
+    const int width = image.width();
+    const int height = image.height();
+    if(width > std::numeric_limits<uint16_t>::max()) return false;
+
+    frame.size = image.size();
+    frame.rows.reserve(height + 1);
+
+    std::unordered_map<uint32_t, uint8_t> colors;
+    // Neighbouring pixels mostly have the same color
+    uint32_t last_color = 0;
+    uint8_t last_index = 0;
+    bool have_last = false;
+
+    for(int y = 0; y < height; y++) {
+        frame.rows.push_back(frame.runs.size());
+        const uint32_t *line = reinterpret_cast<const uint32_t*>(image.constScanLine(y));
+
+        int x = 0;
+        for(;;) {
+            // Fully transparent pixels are 0 once premultiplied, they are not stored
+            while(x < width && line[x] == 0) x++;
+            if(x == width) break;
+
+            Run run;
+            run.x = x;
+            for(; x < width && line[x] != 0; x++) {
+                if(!have_last || line[x] != last_color) {
+                    auto found = colors.find(line[x]);
+                    if(found != colors.end()) {
+                        last_index = found->second;
+                    }else{
+                        if(colors.size() == 256) return false;
+                        last_index = colors.size();
+                        colors.insert({line[x], last_index});
+                        frame.palette.push_back(line[x]);
+                    }
+                    last_color = line[x];
+                    have_last = true;
+                }
+                frame.indices.push_back(last_index);
+            }
+            run.length = x - run.x;
+            frame.runs.push_back(run);
+        }
+    }
+    frame.rows.push_back(frame.runs.size());
+
+    frame.indices.shrink_to_fit();
+    frame.runs.shrink_to_fit();
+    return true;
+}
+
+int AnimationFrames::frame_count() const
+{
+    return source ? source->frame_count() : frames.size();
+}
+
+bool AnimationFrames::is_indexed(int frame) const
+{
+    return !source && frames[frame].image.isNull() && !frames[frame].rows.empty();
+}
+
+bool AnimationFrames::is_mirrored() const
+{
+    return source != nullptr;
+}
+
+const QImage& AnimationFrames::argb(int frame, QImage &buffer) const
+{
+    const QImage &stored = image(frame);
+    if(!stored.isNull()) return stored;
+
+    expand(frame, buffer);
+    return buffer;
+}
+
+bool AnimationFrames::is_mirror_of(const AnimationFrames &other) const
+{
+    if(frame_count() != other.frame_count() || delays != other.delays || size != other.size) return false;
+
+    QImage buffer;
+    QImage other_buffer;
+    for(int i = 0; i < frame_count(); i++) {
+        const QImage &a = argb(i, buffer);
+        const QImage &b = other.argb(i, other_buffer);
+        if(a.size() != b.size()) return false;
+
+        const int width = a.width();
+        for(int y = 0; y < a.height(); y++) {
+            const uint32_t *line = reinterpret_cast<const uint32_t*>(a.constScanLine(y));
+            const uint32_t *other_line = reinterpret_cast<const uint32_t*>(b.constScanLine(y));
+            if(!std::equal(line, line + width, std::reverse_iterator<const uint32_t*>(other_line + width))) return false;
+        }
+    }
+
+    return true;
+}
+
+QRect AnimationFrames::frame_bounds(int frame) const
+{
+    if(source) return flipped(source->frame_bounds(frame), source->frames[frame].size.width());
+
+    return frames[frame].bounds;
+}
+
+const QImage& AnimationFrames::image(int frame) const
+{
+    static const QImage no_image;
+    if(source) return no_image;
+
+    return frames[frame].image;
+}
+
+void AnimationFrames::expand(int frame_index, QImage &into) const
+{
+    if(source) {
+        const QImage &original = source->image(frame_index);
+        if(original.isNull()) {
+            // Indexed, expand it and flip the rows in place
+            source->expand(frame_index, into);
+            for(int y = 0; y < into.height(); y++) {
+                uint32_t *line = reinterpret_cast<uint32_t*>(into.scanLine(y));
+                std::reverse(line, line + into.width());
+            }
+            return;
+        }
+
+        if(into.size() != original.size() || into.format() != QImage::Format_ARGB32_Premultiplied) {
+            into = QImage(original.size(), QImage::Format_ARGB32_Premultiplied);
+        }
+        for(int y = 0; y < original.height(); y++) {
+            const uint32_t *line = reinterpret_cast<const uint32_t*>(original.constScanLine(y));
+            std::reverse_copy(line, line + original.width(), reinterpret_cast<uint32_t*>(into.scanLine(y)));
+        }
+        return;
+    }
+
+    const Frame &frame = frames[frame_index];
+    const int width = frame.size.width();
+
+    if(into.size() != frame.size || into.format() != QImage::Format_ARGB32_Premultiplied) {
+        into = QImage(frame.size, QImage::Format_ARGB32_Premultiplied);
+    }
+
+    const uint32_t *palette = frame.palette.data();
+    const uint8_t *index = frame.indices.data();
+
+    for(int y = 0; y < frame.size.height(); y++) {
+        uint32_t *line = reinterpret_cast<uint32_t*>(into.scanLine(y));
+
+        // Clear the transparent gaps between the runs and look up the colors of the runs
+        int x = 0;
+        for(uint32_t r = frame.rows[y]; r < frame.rows[y + 1]; r++) {
+            const Run &run = frame.runs[r];
+            std::fill(line + x, line + run.x, 0u);
+
+            uint32_t *out = line + run.x;
+            for(int i = 0; i < run.length; i++) {
+                out[i] = palette[index[i]];
+            }
+            index += run.length;
+            x = run.x + run.length;
+        }
+        std::fill(line + x, line + width, 0u);
+    }
+}
+
+AnimationCache::AnimationCache()
+    : total_bytes(0), max_bytes(64*1024*1024), use_counter(0), indexed(false), shared_files(0), shared_bytes(0)
+{
+}
+
+AnimationCache& AnimationCache::instance()
+{
+    static AnimationCache cache;
+    return cache;
+}
+
+// Hash of the contents of a file, identical files in different pony directories are decoded once
+static QByteArray content_key(const QString &path, const QByteArray &data, bool readable)
+{
+    if(!readable) {
+        // Not shared, so the error is reported for every missing file
+        return path.toUtf8();
+    }
+    return QCryptographicHash::hash(data, QCryptographicHash::Sha1);
+}
+
+std::shared_ptr<const AnimationFrames> AnimationCache::get(const QString &path)
+{
+    QString key = QDir::cleanPath(path);
+
+    QMutexLocker lock(&mutex);
+
+    // The other images of the behaviors and effects using this one, which we may be a mirror of
+    const QSet<QString> key_partners = partners.value(key);
+
+    for(;;) {
+        Entry *found = lookup(key);
+        if(found != nullptr) {
+            found->last_used = ++use_counter;
+            return found->frames;
+        }
+
+        // Another thread (i.e. the prefetcher) is decoding it, it will be done sooner than if we started over.
+        // The same if it is decoding a partner, we may not have to decode ours then. The partner never
+        // waits for us in turn, we are not in 'decoding' yet.
+        bool partner_decoding = false;
+        for(const QString &i: key_partners) {
+            partner_decoding = partner_decoding || decoding.contains(i);
+        }
+        if(!decoding.contains(key) && !partner_decoding) break;
+        decoded.wait(&mutex);
+    }
+
+    decoding.insert(key);
+    const bool indexed_frames = indexed;
+
+    // Only partners which are decoded already can be compared with
+    struct Partner {
+        QString path;
+        std::shared_ptr<const AnimationFrames> frames;
+        QByteArray content;
+    };
+    std::vector<Partner> decoded_partners;
+    for(const QString &i: key_partners) {
+        Entry *found = lookup(i);
+        if(found != nullptr) {
+            Partner partner = { i, found->frames, paths.value(i) };
+            decoded_partners.push_back(partner);
+        }
+    }
+
+    // Read and decode without holding the lock, so other threads can decode other animations at the same time
+    lock.unlock();
+
+    std::shared_ptr<const AnimationFrames> frames;
+    QByteArray content;
+
+    // Compared on an earlier run, we do not even have to read the file. Kept by the contents
+    // of the partner, so images mirroring identical files share their frames as well.
+    std::vector<const Partner*> unknown_partners;
+    for(const Partner &i: decoded_partners) {
+        const MirrorCache::Result mirror = MirrorCache::instance().lookup(key, i.path);
+        if(mirror == MirrorCache::Mirrored) {
+            frames = AnimationFrames::mirror(i.frames, key);
+            content = "mirror:" + i.content;
+            break;
+        }
+        if(mirror == MirrorCache::Unknown) {
+            unknown_partners.push_back(&i);
+        }
+    }
+
+    if(!frames) {
+        // The file is read once, for the hash and for decoding
+        QFile file(key);
+        const bool readable = file.open(QIODevice::ReadOnly);
+        const QByteArray data = readable ? file.readAll() : QByteArray();
+        file.close();
+
+        content = content_key(key, data, readable);
+
+        lock.relock();
+        auto same = entries.find(content);
+        if(same != entries.end()) {
+            // Another pony has the same file
+            frames = same->frames;
+            shared_files++;
+            shared_bytes += frames->bytes;
+        }
+        lock.unlock();
+
+        if(!frames) {
+            frames = std::make_shared<AnimationFrames>(key, data, indexed_frames);
+
+            // Drawn from the first partner we are a mirror of
+            for(const Partner *i: unknown_partners) {
+                const bool mirrored = frames->frame_count() != 0 && frames->is_mirror_of(*i->frames);
+                MirrorCache::instance().record(key, i->path, mirrored);
+                if(mirrored) {
+                    frames = AnimationFrames::mirror(i->frames, key);
+                    break;
+                }
+            }
+        }
+    }
+
+    lock.relock();
+
+    decoding.remove(key);
+    decoded.wakeAll();
+
+    paths.insert(key, content);
+
+    auto found = entries.find(content);
+    if(found != entries.end()) {
+        // The same file was decoded for another path meanwhile, or we used its frames above
+        if(found->frames != frames) {
+            shared_files++;
+            shared_bytes += found->frames->bytes;
+        }
+        found->last_used = ++use_counter;
+        return found->frames;
+    }
+
+    Entry entry;
+    entry.frames = frames;
+    entry.last_used = ++use_counter;
+
+    total_bytes += entry.frames->bytes;
+    entries.insert(content, entry);
+
+    trim();
+
+    return entry.frames;
+}
+
+// Frames of the file at 'key', if they are cached. Called with the mutex locked.
+AnimationCache::Entry* AnimationCache::lookup(const QString &key)
+{
+    auto path = paths.find(key);
+    if(path == paths.end()) return nullptr;
+
+    auto found = entries.find(path.value());
+    if(found == entries.end()) return nullptr;
+
+    return &found.value();
+}
+
+std::shared_ptr<const AnimationFrames> AnimationCache::find(const QString &path)
+{
+    QMutexLocker lock(&mutex);
+
+    Entry *found = lookup(QDir::cleanPath(path));
+    if(found == nullptr) return nullptr;
+
+    found->last_used = ++use_counter;
+    return found->frames;
+}
+
+bool AnimationCache::contains(const QString &path) const
+{
+    QMutexLocker lock(&mutex);
+    auto found = paths.find(QDir::cleanPath(path));
+    return found != paths.end() && entries.contains(found.value());
+}
+
+int AnimationCache::deduplicated_files() const
+{
+    QMutexLocker lock(&mutex);
+    return shared_files;
+}
+
+size_t AnimationCache::deduplicated_bytes() const
+{
+    QMutexLocker lock(&mutex);
+    return shared_bytes;
+}
+
+void AnimationCache::add_mirror_pair(const QString &left, const QString &right)
+{
+    const QString left_key = QDir::cleanPath(left);
+    const QString right_key = QDir::cleanPath(right);
+    if(left_key == right_key) return;
+
+    QMutexLocker lock(&mutex);
+    partners[left_key].insert(right_key);
+    partners[right_key].insert(left_key);
+}
+
+void AnimationCache::set_budget(size_t bytes)
+{
+    QMutexLocker lock(&mutex);
+    max_bytes = bytes;
+    trim();
+}
+
+size_t AnimationCache::budget() const
+{
+    QMutexLocker lock(&mutex);
+    return max_bytes;
+}
+
+void AnimationCache::set_indexed(bool enabled)
+{
+    QMutexLocker lock(&mutex);
+    indexed = enabled;
+}
+
+size_t AnimationCache::size() const
+{
+    QMutexLocker lock(&mutex);
+    return total_bytes;
+}
+
+void AnimationCache::clear()
+{
+    QMutexLocker lock(&mutex);
+
+    // Only drop our references, animations still in use stay alive until their users release them
+    entries.clear();
+    paths.clear();
+    total_bytes = 0;
+}
+
+// Evict the least recently used animations nobody is using, until we fit in the budget.
+// Called with the mutex locked.
+void AnimationCache::trim()
+{
+    if(total_bytes <= max_bytes) return;
+
+    std::vector<std::pair<uint64_t, QByteArray>> unused;
+    for(auto i = entries.constBegin(); i != entries.constEnd(); ++i) {
+        // The cache holds the only reference
+        if(i->frames.use_count() == 1) {
+            unused.push_back({i->last_used, i.key()});
+        }
+    }
+
+    std::sort(unused.begin(), unused.end());
+
+    for(auto &i: unused) {
+        if(total_bytes <= max_bytes) break;
+
+        total_bytes -= entries.value(i.second).frames->bytes;
+        entries.remove(i.second);
+    }
+}
+
+const int64_t AnimationPrefetcher::histogram_limits[] = { 1000, 2000, 5000, 10000, 20000, 50000, 100000 };
+
+AnimationPrefetcher::AnimationPrefetcher()
+    : hit_count(0), miss_count(0)
+{
+    for(int i = 0; i < histogram_size; i++) {
+        histogram[i] = 0;
+    }
+}
+
+AnimationPrefetcher& AnimationPrefetcher::instance()
+{
+    static AnimationPrefetcher prefetcher;
+    return prefetcher;
+}
+
+void AnimationPrefetcher::prefetch(const QString &path)
+{
+    const QString key = QDir::cleanPath(path);
+    if(AnimationCache::instance().contains(key)) return;
+
+    {
+        QMutexLocker lock(&mutex);
+        if(pending.contains(key)) return;
+        pending.insert(key);
+    }
+
+    QtConcurrent::run(decode, key);
+}
+
+// Runs on the thread pool. The frames stay in the cache after we drop them, until they are needed or evicted.
+void AnimationPrefetcher::decode(const QString &path)
+{
+    AnimationCache::instance().get(path);
+
+    AnimationPrefetcher &prefetcher = instance();
+    QMutexLocker lock(&prefetcher.mutex);
+    prefetcher.pending.remove(path);
+}
+
+void AnimationPrefetcher::record_switch(bool hit, int64_t usec)
+{
+    QMutexLocker lock(&mutex);
+
+    if(hit) {
+        hit_count++;
+    }else{
+        miss_count++;
+    }
+
+    int range = 0;
+    while(range < histogram_size - 1 && usec >= histogram_limits[range]) {
+        range++;
+    }
+    histogram[range]++;
+}
+
+uint64_t AnimationPrefetcher::hits() const
+{
+    QMutexLocker lock(&mutex);
+    return hit_count;
+}
+
+uint64_t AnimationPrefetcher::misses() const
+{
+    QMutexLocker lock(&mutex);
+    return miss_count;
+}
+
+std::vector<uint64_t> AnimationPrefetcher::latency_histogram() const
+{
+    QMutexLocker lock(&mutex);
+    return std::vector<uint64_t>(histogram, histogram + histogram_size);
+}
+
+QString AnimationPrefetcher::report() const
+{
+    QMutexLocker lock(&mutex);
+
+    QString text = QString("hits: %1 misses: %2 latency:").arg(hit_count).arg(miss_count);
+    for(int i = 0; i < histogram_size - 1; i++) {
+        text += QString(" <%1ms: %2").arg(histogram_limits[i] / 1000.0).arg(histogram[i]);
+    }
+    text += QString(" more: %1").arg(histogram[histogram_size - 1]);
+
+    return text;
+}
+
+AnimationClock::AnimationClock()
+    : current_time(QDateTime::currentMSecsSinceEpoch())
+{
+}
+
+AnimationClock& AnimationClock::instance()
+{
+    static AnimationClock clock;
+    return clock;
+}
+
+int64_t AnimationClock::time() const
+{
+    return current_time;
+}
+
+void AnimationClock::add(Animation *animation)
+{
+    animation->clock_slot = running.size();
+    running.push_back(animation);
+}
+
+void AnimationClock::remove(Animation *animation)
+{
+    // Move the last animation into the free slot
+    Animation *last = running.back();
+    running[animation->clock_slot] = last;
+    last->clock_slot = animation->clock_slot;
+    running.pop_back();
+
+    animation->clock_slot = -1;
+}
+
+void AnimationClock::add_loading(Animation *animation)
+{
+    loading.push_back(animation);
+}
+
+void AnimationClock::remove_loading(Animation *animation)
+{
+    auto found = std::find(loading.begin(), loading.end(), animation);
+    if(found == loading.end()) return;
+
+    *found = loading.back();
+    loading.pop_back();
+}
+
+void AnimationClock::advance(int64_t time)
+{
+    current_time = time;
+
+    // Hand over the animations the thread pool finished decoding
+    for(size_t i = 0; i < loading.size();) {
+        Animation *animation = loading[i];
+        if(animation->decoding->ready.load(std::memory_order_acquire)) {
+            loading[i] = loading.back();
+            loading.pop_back();
+            animation->finish_loading();
+        }else{
+            i++;
+        }
+    }
+
+    // Slots connected to frame_changed only repaint, they do not start or stop animations
+    for(Animation *i: running) {
+        if(i->next_frame_time <= time && i->advance(time)) {
+            emit i->frame_changed(i->frame);
+        }
+    }
+}
+
+int64_t AnimationClock::next_frame_time() const
+{
+    int64_t next = std::numeric_limits<int64_t>::max();
+    for(const Animation *i: running) {
+        next = std::min(next, i->next_frame_time);
+    }
+    return next;
+}
+
+Animation::Animation(const QString &path, QObject *parent)
+    : QObject(parent), frames(AnimationCache::instance().find(path)), frame(0), next_frame_time(0), clock_slot(-1), expanded_frame(-1), start_pending(false)
+{
+    if(frames) return;
+
+    // Never decode on the GUI thread, show nothing until the thread pool is done
+    static const std::shared_ptr<const AnimationFrames> no_frames = std::make_shared<AnimationFrames>();
+    frames = no_frames;
+
+    decoding = std::make_shared<Decoding>();
+    decoding->path = path;
+    decoding->ready.store(false);
+
+    AnimationClock::instance().add_loading(this);
+    QtConcurrent::run(decode, decoding);
+}
+
+Animation::~Animation()
+{
+    stop();
+    if(decoding) {
+        // The worker keeps its own reference, the frames stay in the cache when it is done
+        AnimationClock::instance().remove_loading(this);
+    }
+}
+
+// Runs on the thread pool
+void Animation::decode(std::shared_ptr<Decoding> decoding)
+{
+    decoding->frames = AnimationCache::instance().get(decoding->path);
+    decoding->ready.store(true, std::memory_order_release);
+
+    // The clock lives on the GUI thread, so the update loop is woken up there
+    QMetaObject::invokeMethod(&AnimationClock::instance(), "frames_decoded", Qt::QueuedConnection);
+}
+
+void Animation::finish_loading()
+{
+    frames = decoding->frames;
+    expanded_frame = -1;
+    decoding.reset();
+
+    if(start_pending) {
+        start_pending = false;
+        start();
+    }
+    emit loaded();
+}
+
+bool Animation::is_loaded() const
+{
+    return decoding == nullptr;
+}
+
+bool Animation::is_valid() const
+{
+    return frames->frame_count() != 0;
+}
+
+bool Animation::is_running() const
+{
+    return clock_slot != -1;
+}
+
+void Animation::start()
+{
+    if(!is_loaded()) {
+        start_pending = true;
+        return;
+    }
+
+    if(frames->frame_count() > 1) {
+        next_frame_time = AnimationClock::instance().time() + frames->delays[frame];
+        if(!is_running()) {
+            AnimationClock::instance().add(this);
+        }
+    }
+    emit frame_changed(frame);
+}
+
+void Animation::stop()
+{
+    start_pending = false;
+    if(is_running()) {
+        AnimationClock::instance().remove(this);
+    }
+}
+
+void Animation::jump_to_frame(int new_frame)
+{
+    if(new_frame < 0 || new_frame >= frame_count()) return;
+
+    frame = new_frame;
+    if(is_running()) {
+        next_frame_time = AnimationClock::instance().time() + frames->delays[frame];
+    }
+    emit frame_changed(frame);
+}
+
+int Animation::frame_count() const
+{
+    return frames->frame_count();
+}
+
+int Animation::current_frame() const
+{
+    return frame;
+}
+
+const QImage& Animation::current_image() const
+{
+    static const QImage null_image;
+    if(frames->frame_count() == 0) return null_image;
+
+    const QImage &stored = frames->image(frame);
+    if(!stored.isNull()) return stored;
+
+    // Expanded once per frame shown, the window and the overlay draw it several times
+    if(expanded_frame != frame) {
+        frames->expand(frame, expanded);
+        expanded_frame = frame;
+    }
+    return expanded;
+}
+
+QSize Animation::size() const
+{
+    return frames->size;
+}
+
+QRect Animation::bounds() const
+{
+    return frames->bounds;
+}
+
+QRect Animation::current_bounds() const
+{
+    if(frames->frame_count() == 0) return QRect();
+
+    return frames->frame_bounds(frame);
+}
+
+bool Animation::advance(int64_t time)
+{
+    const int old_frame = frame;
+    const int count = frames->frame_count();
+
+    // Skip the frames we missed, if the ticks are slower than the animation
+    while(next_frame_time <= time) {
+        frame = (frame + 1) % count;
+        next_frame_time += frames->delays[frame];
+
+        // Way behind (i.e. the computer was suspended), restart the timing from now
+        if(time - next_frame_time > 1000) {
+            next_frame_time = time + frames->delays[frame];
+        }
+    }
+
+    return frame != old_frame;
+}
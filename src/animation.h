@@ -0,0 +1,307 @@
+/*
+ * Qt-ponies - ponies on the desktop
+ * Copyright (C) 2012 mysha
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ANIMATION_H
+#define ANIMATION_H
+
+#include <QObject>
+#include <QString>
+#include <QImage>
+#include <QHash>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QSet>
+#include <QByteArray>
+#include <QSize>
+#include <QRect>
+
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <cstdint>
+
+class QImageReader;
+
+// Decoded frames of one animation file.
+// Instances are immutable once loaded and shared between every user of the same file.
+class AnimationFrames
+{
+public:
+    // No frames, shown while the real ones are decoded
+    AnimationFrames();
+    // With 'indexed' set, frames with at most 256 colors are kept as 8-bit palette indices
+    // of their opaque pixels, about a quarter of the memory, and expanded to ARGB when drawn
+    AnimationFrames(const QString &path, bool indexed);
+    // Decode the contents of the file at 'path', which were read already
+    AnimationFrames(const QString &path, const QByteArray &data, bool indexed);
+    // The frames of 'source' flipped horizontally, sharing its memory
+    AnimationFrames(const std::shared_ptr<const AnimationFrames> &source, const QString &path);
+
+    // Frames of the image at 'path', which is a mirror of 'source'
+    static std::shared_ptr<const AnimationFrames> mirror(const std::shared_ptr<const AnimationFrames> &source, const QString &path);
+
+    int frame_count() const;
+    bool is_indexed(int frame) const;
+    bool is_mirrored() const;
+    // Are the frames of 'other' the same as ours, flipped horizontally
+    bool is_mirror_of(const AnimationFrames &other) const;
+
+    // Part of a frame that is not fully transparent, empty if none is
+    QRect frame_bounds(int frame) const;
+
+    // Premultiplied ARGB frame, a null image if the frame is indexed or mirrored
+    const QImage& image(int frame) const;
+    // Expand an indexed or mirrored frame to premultiplied ARGB, reusing the memory of 'into' if it has the right size
+    void expand(int frame, QImage &into) const;
+
+    QString path;
+    std::vector<int> delays; // Delay after each frame in msec
+    QSize size;
+    QRect bounds;            // Union of the bounds of every frame, windows only have to be this large
+    size_t bytes;            // Memory used by the decoded frames
+
+private:
+    // Pixels of a row that are not transparent
+    struct Run {
+        uint16_t x;
+        uint16_t length;
+    };
+
+    struct Frame {
+        QImage image;                 // Null if the frame is indexed
+        QSize size;
+        QRect bounds;
+        std::vector<uint32_t> palette; // Premultiplied ARGB
+        std::vector<uint8_t> indices;  // Palette index of every opaque pixel, row by row
+        std::vector<Run> runs;
+        std::vector<uint32_t> rows;    // First run of each row, and the end of the last row
+    };
+
+    void decode(QImageReader &reader, bool indexed);
+    static bool make_indexed(const QImage &image, Frame &frame);
+    static QRect opaque_bounds(const QImage &image);
+    static QRect indexed_bounds(const Frame &frame);
+    // Bounds of the same part of a frame 'width' pixels wide, flipped horizontally
+    static QRect flipped(const QRect &bounds, int width);
+    // The frame as ARGB, expanded into 'buffer' if needed
+    const QImage& argb(int frame, QImage &buffer) const;
+
+    std::vector<Frame> frames;
+    std::shared_ptr<const AnimationFrames> source; // Frames we are the mirror of, we have none of our own then
+};
+
+// Process-wide cache of decoded animations, keyed by a hash of the file contents, so identical
+// files in different pony directories share their frames. Files are only read and hashed once.
+// Animations that are in use are never evicted. Unused ones are kept around
+// (so we do not decode them again on the next behavior change) until the
+// total size of the cache exceeds the memory budget, then the least recently
+// used are dropped. Animations can be decoded on several threads at once, a thread asking
+// for an animation another one is decoding waits for it instead of decoding it again.
+class AnimationCache
+{
+public:
+    static AnimationCache& instance();
+
+    // Decodes the animation if it is not cached, blocking until it is done
+    std::shared_ptr<const AnimationFrames> get(const QString &path);
+    // Cached frames, or nullptr without waiting if the animation is not decoded yet
+    std::shared_ptr<const AnimationFrames> find(const QString &path);
+    // Is the animation decoded already
+    bool contains(const QString &path) const;
+    // Files which were found to have the same contents as a decoded one, and the memory their frames would have used
+    int deduplicated_files() const;
+    size_t deduplicated_bytes() const;
+    // 'left' and 'right' are the images of the same behavior or effect, and may be mirrors of each other.
+    // When both are used, the one decoded last is compared with the other, and drawn from its frames if it is a mirror.
+    // An image can have several partners, it is compared with each of them that is decoded.
+    void add_mirror_pair(const QString &left, const QString &right);
+
+    void set_budget(size_t bytes);
+    size_t budget() const;
+    // Store the animations decoded from now on as palette indices, see AnimationFrames
+    void set_indexed(bool indexed);
+    size_t size() const;
+    void clear();
+
+private:
+    AnimationCache();
+    AnimationCache(const AnimationCache&) = delete;
+    AnimationCache& operator=(const AnimationCache&) = delete;
+
+    struct Entry {
+        std::shared_ptr<const AnimationFrames> frames;
+        uint64_t last_used;
+    };
+
+    Entry* lookup(const QString &key);
+    void trim();
+
+    mutable QMutex mutex;
+    QWaitCondition decoded;
+    QHash<QByteArray, Entry> entries; // By the hash of the file contents
+    QHash<QString, QByteArray> paths;  // Hash of the contents of each file we decoded
+    QSet<QString> decoding;
+    // Images that may be mirrors of each image, both ways. The same file can be used by
+    // several behaviors or effects, with a different partner in each.
+    QHash<QString, QSet<QString>> partners;
+    size_t total_bytes;
+    size_t max_bytes;
+    uint64_t use_counter;
+    bool indexed;
+    int shared_files;
+    size_t shared_bytes;
+};
+
+// Decodes animations that will probably be shown soon on the thread pool, so changing
+// behavior does not stall the GUI thread. Also keeps statistics of the animations the
+// GUI thread switched to, to see how often they were ready.
+class AnimationPrefetcher
+{
+public:
+    static AnimationPrefetcher& instance();
+
+    // Start decoding the animation, if it is not in the cache yet
+    void prefetch(const QString &path);
+
+    // A pony switched to an animation, which was decoded already (hit) or not, and it was shown after 'usec'
+    void record_switch(bool hit, int64_t usec);
+    uint64_t hits() const;
+    uint64_t misses() const;
+    // Number of switches for each of the ranges of histogram_limits
+    std::vector<uint64_t> latency_histogram() const;
+    // Hits, misses and the histogram on one line, for the debug log
+    QString report() const;
+
+    // Upper limits of the latency ranges in usec, the last range has no limit
+    static const int64_t histogram_limits[];
+    static const int histogram_size = 8;
+
+private:
+    AnimationPrefetcher();
+    AnimationPrefetcher(const AnimationPrefetcher&) = delete;
+    AnimationPrefetcher& operator=(const AnimationPrefetcher&) = delete;
+
+    static void decode(const QString &path);
+
+    mutable QMutex mutex;
+    QSet<QString> pending;
+    uint64_t hit_count;
+    uint64_t miss_count;
+    uint64_t histogram[histogram_size];
+};
+
+class Animation;
+
+// Shows the next frames of every playing Animation in one pass.
+// Driven by the update timer of the ponies, so the number of timer wakeups does not
+// grow with the number of animated sprites, and all frame changes of a tick are
+// repainted together. Frames are shown on the first tick after their delay passed.
+class AnimationClock : public QObject
+{
+    Q_OBJECT
+public:
+    static AnimationClock& instance();
+
+    // Advance every animation to 'time' (in msec)
+    void advance(int64_t time);
+    int64_t time() const;
+    // Time the next frame of any animation is due, or the largest int64_t if nothing is playing.
+    // Animations being decoded are not waited for, frames_decoded() tells when to advance again.
+    int64_t next_frame_time() const;
+
+signals:
+    // Emitted on the GUI thread after the thread pool decoded the frames of an animation,
+    // they are handed over on the next advance()
+    void frames_decoded();
+
+private:
+    friend class Animation;
+
+    AnimationClock();
+    AnimationClock(const AnimationClock&) = delete;
+    AnimationClock& operator=(const AnimationClock&) = delete;
+
+    void add(Animation *animation);
+    void remove(Animation *animation);
+    void add_loading(Animation *animation);
+    void remove_loading(Animation *animation);
+
+    std::vector<Animation*> running;
+    std::vector<Animation*> loading; // Waiting for their frames to be decoded
+    int64_t current_time;
+};
+
+// Playback state of a shared animation: current frame and time of the next one.
+// Drop-in replacement for the parts of QMovie we used.
+class Animation : public QObject
+{
+    Q_OBJECT
+public:
+    // Animations which are not cached are decoded on the thread pool, loaded() is emitted
+    // once their frames are ready. Until then the animation has no frames.
+    explicit Animation(const QString &path, QObject *parent = 0);
+    ~Animation();
+
+    bool is_loaded() const;
+    bool is_valid() const;
+    void start();
+    void stop();
+    void jump_to_frame(int frame);
+
+    int frame_count() const;
+    int current_frame() const;
+    const QImage& current_image() const;
+    QSize size() const;
+    // Part of the images that is drawn, of every frame and of the current frame
+    QRect bounds() const;
+    QRect current_bounds() const;
+
+signals:
+    void frame_changed(int frame);
+    void loaded();
+
+private:
+    friend class AnimationClock;
+
+    // Handed from the thread pool to the GUI thread. The worker sets 'frames' and then 'ready',
+    // the clock checks 'ready' on every tick, so neither side ever waits for the other.
+    struct Decoding {
+        QString path;
+        std::shared_ptr<const AnimationFrames> frames;
+        std::atomic<bool> ready;
+    };
+
+    static void decode(std::shared_ptr<Decoding> decoding);
+    // Called by the clock when the frames are decoded
+    void finish_loading();
+
+    bool is_running() const;
+    // Called by the clock, returns true if the frame changed
+    bool advance(int64_t time);
+
+    std::shared_ptr<const AnimationFrames> frames;
+    int frame;
+    int64_t next_frame_time;
+    int clock_slot; // Index in AnimationClock::running, -1 when stopped
+    mutable QImage expanded;   // Current frame, if it is indexed
+    mutable int expanded_frame; // Frame in 'expanded', -1 if none
+    std::shared_ptr<Decoding> decoding; // nullptr once loaded
+    bool start_pending; // start() was called before the frames were decoded
+};
+
+#endif // ANIMATION_H
@@ -19,29 +19,24 @@
 #ifndef BEHAVIOR_H
 #define BEHAVIOR_H
 
-#include <QMovie>
 #include <QString>
 #include <QVariant>
 
+#include <vector>
 #include <cstdint>
 
 #include "csv_parser.h"
 
-class Pony;
+class Effect;
+class Speak;
 
+// Behavior as defined in pony.ini.
+// Definitions are shared by every instance of a pony and are not modified after loading,
+// the state of the behavior a pony is currently doing is kept by the Pony.
 class Behavior
 {
 public:
-    Behavior(Pony* parent, const QString filepath, const std::vector<QVariant> &options);
-    Behavior(const Behavior &) = default;
-    Behavior(Behavior &&b);
-    ~Behavior();
-
-    Behavior& operator=(const Behavior&) = default;
-
-    void init();
-    void deinit();
-    void update();
+    Behavior(const QString filepath, const std::vector<QVariant> &options);
 
     enum Direction { Left = -1, Right = 1, Down = 1, Up = -1, Stand = 0};
 
@@ -68,18 +63,11 @@ public:
     static const CSVParser::ParseTypes OptionTypes;
 
     float speed;
-    int x_center;
-    int y_center;
-    State state;
     State type;
-    QMovie* current_animation;
-    int width;
-    int height;
     uint8_t movement_allowed;
     float duration_min;
     float duration_max;
     float probability;
-    QPoint destanation_point;
     QString path;
     QString animation_left;
     QString animation_right;
@@ -94,29 +82,20 @@ public:
     int32_t y_coordinate;
     QString follow_object;
 
+    // (0,0) if not specified, the center of the image is used then
     QPoint right_image_center;
     QPoint left_image_center;
 
-    // We do not need follow_stopped centers
-    QPoint follow_moving_right_image_center;
-    QPoint follow_moving_left_image_center;
-
-    int direction_h;
-    int direction_v;
-
-private:
-    void choose_angle();
-    void change_direction(bool right, bool moving = true);
-
-    QMovie* animations[4]; /* 0 - left  / follow_moving left
-                              1 - right / follow_moving right
-                              2 - follow_stopped left
-                              3 - follow_stopped right
-                           */
-    Pony* parent;
-    int movement;
-    bool moving;
-    float angle;
+    // The names above, resolved by PonyTemplate when the pony is loaded.
+    // nullptr if the name is empty or does not exist.
+    const Behavior *linked;
+    const Behavior *follow_stopped;
+    const Behavior *follow_moving;
+    Speak *starting_speech;
+    Speak *ending_speech;
+
+    // Effects started with this behavior
+    std::vector<const Effect*> effects;
 };
 
 
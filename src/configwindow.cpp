@@ -16,19 +16,30 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <QApplication>
+#include <QDesktopWidget>
 #include <QDir>
 #include <QFileDialog>
+#include <QDesktopServices>
 #include <QDateTime>
-#include <QFile>
-#include <QTextStream>
+#include <QElapsedTimer>
 #include <QDebug>
+#include <QHash>
 
 #include <algorithm>
+#include <limits>
 #include <cmath>
 
 #include "configwindow.h"
 #include "ui_configwindow.h"
 #include "debugwindow.h"
+#include "animation.h"
+#include "overlay.h"
+#include "ponywindow.h"
+#include "runtimeconfig.h"
+#include "ponydatabase.h"
+#include "mirrorcache.h"
+#include "ponyloader.h"
 
 // TODO: configuration:
 //       monitors (on witch to run, etc)
@@ -44,12 +55,35 @@ const std::unordered_map<QString, const QVariant> ConfigWindow::config_defaults
     {"general/effects-enabled",      true                },
     {"general/debug",                false               },
     {"general/show-advanced",        false               },
+    {"general/animation-cache-size", 64                  },
+    {"general/indexed-frames",       false               },
+    {"general/overlay-mode",         false               },
+    {"general/random-seed",          0                   },
+    {"general/update-rate",          33                  },
     {"speech/enabled",               true                },
     {"speech/probability",           50                  },
     {"speech/duration",              2000                },
     {"sound/enabled",                false               }
 };
 
+// Settings without a widget in the configuration window, only set in the configuration file.
+// save_settings() writes them back unchanged.
+static const char *const file_only_settings[] = {
+    "general/random-seed",
+    "general/update-rate",
+    "general/indexed-frames"
+};
+
+// Range of the update rate in updates per second
+static const int min_update_rate = 10;
+static const int max_update_rate = 120;
+
+// Minimum time between two updates in msec
+static int64_t update_interval()
+{
+    return 1000 / RuntimeConfig::settings().update_rate;
+}
+
 static DebugWindow* log_class = nullptr;
 static bool debug = false;
 
@@ -62,7 +96,13 @@ void handle_message(QtMsgType type, const char *msg)
 
 ConfigWindow::ConfigWindow(QWidget *parent) :
     QMainWindow(parent),
-    ui(new Ui::ConfigWindow)
+    simulation(current_time(), desktop_screens(), random_seed()),
+    ui(new Ui::ConfigWindow),
+    save_loaded_ponies(false),
+    startup_loading(false),
+    last_update(0),
+    next_update(0),
+    next_wakeup_report(0)
 {
     signal_mapper = new QSignalMapper();
 
@@ -119,6 +159,11 @@ ConfigWindow::ConfigWindow(QWidget *parent) :
 
     load_settings();
 
+    connect(&RuntimeConfig::instance(), SIGNAL(changed()), this, SLOT(apply_settings()));
+    // Show animations decoded on the thread pool, the update loop does not poll for them
+    connect(&AnimationClock::instance(), SIGNAL(frames_decoded()), this, SLOT(wake_up()));
+    publish_settings();
+
     ui->tabbar->setShape(QTabBar::RoundedWest);
 
     // Load available ponies into the list
@@ -136,79 +181,167 @@ ConfigWindow::ConfigWindow(QWidget *parent) :
 
     connect(ui->available_list->selectionModel(), SIGNAL(currentChanged(QModelIndex,QModelIndex)), this, SLOT(newpony_list_changed(QModelIndex)));
 
-    // Start update timer
-    update_timer.setInterval(30);
-    update_timer.start();
+    // Ponies keep using the cached screens until the desktop changes
+    QDesktopWidget *desktop = QApplication::desktop();
+    connect(desktop, SIGNAL(resized(int)), this, SLOT(update_screens()));
+    connect(desktop, SIGNAL(workAreaResized(int)), this, SLOT(update_screens()));
+    connect(desktop, SIGNAL(screenCountChanged(int)), this, SLOT(update_screens()));
 
-    interaction_timer.setInterval(500);
-    interaction_timer.start();
+    // The update timer is started again after every update, for the time something changes next
+    update_timer.setSingleShot(true);
+    QObject::connect(&update_timer, SIGNAL(timeout()), this, SLOT(update_ponies()));
+    wake_up();
 
-    QObject::connect(&interaction_timer, SIGNAL(timeout()), this, SLOT(update_interactions()));
+    // In overlay mode every pony on a screen is drawn by a single window.
+    // This can only be changed on startup, because the pony windows are set up differently.
+    OverlayWindow::set_active(getSetting<bool>("general/overlay-mode"));
+    update_overlays();
 
     // Load every pony specified in configuration
+    pony_loader = new PonyLoader(&simulation, this);
+    connect(pony_loader, SIGNAL(loaded(Pony*)), this, SLOT(pony_loaded(Pony*)));
+    connect(pony_loader, SIGNAL(finished()), this, SLOT(ponies_loaded()));
+
     QSettings settings;
     int size = settings.beginReadArray("loaded-ponies");
     for(int i=0; i< size; i++) {
         settings.setArrayIndex(i);
-        try {
-            ponies.emplace_back(std::make_shared<Pony>(settings.value("name").toString(), this));
-            QObject::connect(&update_timer, SIGNAL(timeout()), ponies.back().get(), SLOT(update()));
-        }catch (std::exception &e) {
-            qCritical() << "Could not load pony" << settings.value("name").toString();
-        }
+        load_pony(settings.value("name").toString());
     }
     settings.endArray();
+    startup_loading = pony_loader->is_loading();
     list_model->sort(1);
 
     update_active_list();
 
     // Load interactions
-    QFile ifile(QString("%1/interactions.ini").arg(getSetting<QString>("general/pony-directory")));
-    if(!ifile.open(QIODevice::ReadOnly | QIODevice::Text)) {
-        qCritical() << "Cannot open interactions.ini";
-        qCritical() << ifile.errorString();
-    }
+    simulation.load_interactions(RuntimeConfig::settings().pony_directory);
+
+}
 
-    if( ifile.isOpen() ) {
-        QString line;
-        QTextStream istr(&ifile);
+ConfigWindow::~ConfigWindow()
+{
+    // Windows must be deleted before the QApplication, the pool would keep them until the very end
+    simulation.ponies.clear();
+    EffectWindowPool::instance().clear();
+    MirrorCache::instance().save();
 
-        while (!istr.atEnd() ) {
-            line = istr.readLine();
+    delete ui;
+    delete signal_mapper;
+    delete list_model;
+    delete action_group;
+}
+
+// Start loading a pony in the background, it is shown by pony_loaded() once it is ready
+void ConfigWindow::load_pony(const QString &path)
+{
+    pony_loader->load(path);
+}
+
+bool ConfigWindow::is_loading() const
+{
+    return pony_loader->is_loading();
+}
+
+void ConfigWindow::pony_loaded(Pony *pony)
+{
+    pony->set_view(new PonyWindow(pony, this));
+    wake_up();
+}
+
+// Called when every pony we started loading is loaded
+void ConfigWindow::ponies_loaded()
+{
+    update_active_list();
 
-            if(line[0] != '\'' && !line.isEmpty()) {
-                std::vector<QVariant> csv_data;
-                CSVParser::ParseLine(csv_data, line, ',', Interaction::OptionTypes);
-                try {
-                    interactions.emplace_back(csv_data);
-                }catch (std::exception &e) {
-                    qCritical() << "Could not load interaction.";
-                }
+    if(save_loaded_ponies) {
+        save_loaded_ponies = false;
+        save_settings();
+    }
 
-            }
+    // None of the saved ponies could be loaded, show the configuration instead of nothing
+    if(startup_loading) {
+        startup_loading = false;
+        if(simulation.ponies.empty()) {
+            show();
         }
+    }
+}
+
+// Called on every tick of the update timer
+void ConfigWindow::update_ponies()
+{
+    const int64_t now = current_time();
+
+    wakeups.push_back(now);
+    while(wakeups.front() <= now - 1000) {
+        wakeups.pop_front();
+    }
+    if(debug && next_wakeup_report <= now) {
+        next_wakeup_report = now + 10000;
+        qDebug() << "Wakeups per second:" << wakeups_per_second();
 
-        ifile.close();
-    }else{
-        qCritical() << "Cannot read interactions.ini";
+        const EffectWindowPool &pool = EffectWindowPool::instance();
+        qDebug() << "Effect windows reused:" << pool.reused() << "created:" << pool.missed() << "free:" << pool.size();
+        qDebug() << "Animation switches" << AnimationPrefetcher::instance().report();
+
+        const AnimationCache &cache = AnimationCache::instance();
+        qDebug() << "Animation files shared with identical ones:" << cache.deduplicated_files()
+                 << "KB saved:" << cache.deduplicated_bytes() / 1024;
+    }
+
+    simulation.update(now);
+
+    // Show the next frames of every pony and effect, their windows are repainted together after this tick
+    AnimationClock::instance().advance(now);
+
+    // Repaint the overlays after every pony has moved in this tick
+    for(const auto &overlay : overlays) {
+        overlay->update_sprites();
     }
 
+    last_update = now;
+    schedule_update(now);
 }
 
-ConfigWindow::~ConfigWindow()
+// Sleep until something on screen changes: a pony moves, a frame of an animation is due,
+// or a timer of the simulation fires. If everypony stands still on a single frame, we do
+// not wake up at all until there is input.
+void ConfigWindow::schedule_update(int64_t time)
 {
-    delete ui;
-    delete signal_mapper;
-    delete list_model;
-    delete action_group;
+    const int64_t next = std::min(simulation.next_update_time(), AnimationClock::instance().next_frame_time());
+    if(next == std::numeric_limits<int64_t>::max()) {
+        update_timer.stop();
+        return;
+    }
+
+    next_update = std::max(next, last_update + update_interval());
+    update_timer.start(static_cast<int>(std::max<int64_t>(next_update - time, 0)));
+}
+
+void ConfigWindow::wake_up()
+{
+    const int64_t now = current_time();
+    const int64_t earliest = std::max(now, last_update + update_interval());
+
+    if(update_timer.isActive() && next_update <= earliest) return;
+
+    next_update = earliest;
+    update_timer.start(static_cast<int>(earliest - now));
+}
+
+int ConfigWindow::wakeups_per_second() const
+{
+    const int64_t now = current_time();
+    return std::count_if(wakeups.begin(), wakeups.end(), [now](int64_t time){ return time > now - 1000; });
 }
 
 void ConfigWindow::remove_pony()
 {
     // Get a pointer to Pony from sender()
     QAction *q = qobject_cast<QAction*>(QObject::sender());
-    Pony* p = static_cast<Pony*>(q->parent()->parent()); // QAction->QMenu->QMainWindow(Pony)
-    ponies.remove(p->get_shared_ptr());
+    PonyWindow* w = static_cast<PonyWindow*>(q->parent()->parent()); // QAction->QMenu->QMainWindow(PonyWindow)
+    simulation.remove_pony(w->pony);
 
     save_settings();
     update_active_list();
@@ -218,9 +351,9 @@ void ConfigWindow::remove_pony_all()
 {
     // Get a pointer to Pony from sender()
     QAction *q = qobject_cast<QAction*>(QObject::sender());
-    Pony* p = static_cast<Pony*>(q->parent()->parent()); // QAction->QMenu->QMainWindow(Pony)
-    QString pony_name(p->name); // We must copy the name, because it will be deleted
-    ponies.remove_if([&pony_name](const std::shared_ptr<Pony> &pony){
+    PonyWindow* w = static_cast<PonyWindow*>(q->parent()->parent()); // QAction->QMenu->QMainWindow(PonyWindow)
+    QString pony_name(w->pony->name); // We must copy the name, because it will be deleted
+    simulation.ponies.remove_if([&pony_name](const std::shared_ptr<Pony> &pony){
         return pony->name == pony_name;
     });
 
@@ -242,14 +375,14 @@ void ConfigWindow::remove_pony_activelist()
         QString name = i.data().toString();
 
         // Find first occurance of pony name
-        auto occurance = std::find_if(ponies.begin(), ponies.end(),
+        auto occurance = std::find_if(simulation.ponies.begin(), simulation.ponies.end(),
                                          [&name](const std::shared_ptr<Pony> &p)
                                          {
                                              return p->directory == name;
                                          });
         // If found, remove
-        if(occurance != ponies.end()) {
-            ponies.erase(occurance);
+        if(occurance != simulation.ponies.end()) {
+            simulation.ponies.erase(occurance);
         }
 
     }
@@ -258,6 +391,81 @@ void ConfigWindow::remove_pony_activelist()
     update_active_list();
 }
 
+// Geometry of the screens of the desktop, as seen by the ponies
+ScreenLayout ConfigWindow::desktop_screens()
+{
+    QDesktopWidget *desktop = QApplication::desktop();
+
+    std::vector<QRect> geometry;
+    std::vector<QRect> available;
+    for(int i = 0; i < desktop->screenCount(); i++) {
+        geometry.push_back(desktop->screenGeometry(i));
+        available.push_back(desktop->availableGeometry(i));
+    }
+
+    return ScreenLayout(geometry, available, desktop->primaryScreen());
+}
+
+void ConfigWindow::update_screens()
+{
+    simulation.set_screens(desktop_screens());
+    update_overlays();
+    wake_up();
+}
+
+// Screens may have been added, removed or resized since the overlays were created
+void ConfigWindow::update_overlays()
+{
+    if(!OverlayWindow::active()) return;
+
+    const ScreenLayout &screens = simulation.screens();
+
+    if(overlays.size() > static_cast<size_t>(screens.count())) {
+        overlays.resize(screens.count());
+    }
+    for(size_t i = 0; i < overlays.size(); i++) {
+        overlays[i]->set_screen_geometry(screens.geometry(i));
+    }
+    for(int i = overlays.size(); i < screens.count(); i++) {
+        overlays.emplace_back(new OverlayWindow(this, screens.geometry(i)));
+    }
+}
+
+// Time of the ponies in msec. It starts at the wall clock time, but does not jump when the clock is changed.
+int64_t ConfigWindow::current_time()
+{
+    static const int64_t start = QDateTime::currentMSecsSinceEpoch();
+    static QElapsedTimer timer;
+    if(!timer.isValid()) {
+        timer.start();
+    }
+    return start + timer.elapsed();
+}
+
+// Seed of the simulation: the one set in the configuration file, to repeat the same run, or a new one
+uint64_t ConfigWindow::random_seed()
+{
+    uint64_t seed = getSetting<qulonglong>("general/random-seed");
+    if(seed == 0) {
+        seed = QDateTime::currentMSecsSinceEpoch();
+    }
+    return seed;
+}
+
+QString ConfigWindow::database_file()
+{
+    QString directory = QDesktopServices::storageLocation(QDesktopServices::CacheLocation);
+    QDir().mkpath(directory);
+    return QString("%1/ponies.db").arg(directory);
+}
+
+QString ConfigWindow::mirror_cache_file()
+{
+    QString directory = QDesktopServices::storageLocation(QDesktopServices::CacheLocation);
+    QDir().mkpath(directory);
+    return QString("%1/mirrors.db").arg(directory);
+}
+
 void ConfigWindow::reload_available_ponies()
 {
     QSettings settings;
@@ -268,28 +476,28 @@ void ConfigWindow::reload_available_ponies()
         ui->tabbar->removeTab(0);
     }
 
-    QDir dir(getSetting<QString>("general/pony-directory", settings) );
-    dir.setFilter(QDir::Dirs | QDir::NoDotAndDotDot);
+    QString pony_directory = getSetting<QString>("general/pony-directory", settings);
+
+    // Use the compiled pony data, compiling it again if any pony changed
+    PonyDatabase::instance().open(pony_directory, database_file());
+    MirrorCache::instance().save();
+    MirrorCache::instance().open(mirror_cache_file());
 
     // Get names of all the pony directories
     QList<QChar> letters;
-    for(auto &i: dir.entryList()) {
-        QDir pony_dir(dir);
-        pony_dir.cd(i);
-        if(pony_dir.exists("pony.ini")) {
-            // Get the letters for TabBar for quick navigation of the available pony list
-            if(!letters.contains(i[0])) {
-                // Add the first letter of the name if we do not have it already
-                letters.push_back(i[0]);
-            }
-
-            QStandardItem *item_icon = new QStandardItem(QIcon(pony_dir.absoluteFilePath("icon.png")),"");
-            QStandardItem *item_text = new QStandardItem(i);
-
-            QList<QStandardItem*> row;
-            row << item_icon << item_text;
-            list_model->appendRow(row);
+    for(auto &i: PonyDatabase::instance().ponies(pony_directory)) {
+        // Get the letters for TabBar for quick navigation of the available pony list
+        if(!letters.contains(i[0])) {
+            // Add the first letter of the name if we do not have it already
+            letters.push_back(i[0]);
         }
+
+        QStandardItem *item_icon = new QStandardItem(QIcon(QDir(pony_directory).absoluteFilePath(QString("%1/icon.png").arg(i))),"");
+        QStandardItem *item_text = new QStandardItem(i);
+
+        QList<QStandardItem*> row;
+        row << item_icon << item_text;
+        list_model->appendRow(row);
     }
     for(QChar &i: letters) ui->tabbar->addTab(i);
 
@@ -315,26 +523,20 @@ void ConfigWindow::add_pony()
         // Get the name from active list
         QString name = i.data().toString();
 
-        try {
-            // Try to initialize the new pony at the end of the active pony list and connect it to the update timer
-            ponies.emplace_back(std::make_shared<Pony>(i.data().toString(), this));
-            QObject::connect(&update_timer, SIGNAL(timeout()), ponies.back().get(), SLOT(update()));
-
-        }catch (std::exception &e) {
-            qCritical() << "Could not load pony" << name;
-        }
+        // Try to initialize the new pony at the end of the active pony list
+        load_pony(name);
 
     }
 
-    save_settings();
-    update_active_list();
+    // The list of active ponies is saved once they are loaded
+    save_loaded_ponies = true;
 }
 
 void ConfigWindow::update_active_list()
 {
     active_list_model->clear();
-    for(auto &i: ponies) {
-        QStandardItem *item_icon = new QStandardItem(QIcon(QString("%1/%2/icon.png").arg(ConfigWindow::getSetting<QString>("general/pony-directory"), i->directory)),"");
+    for(auto &i: simulation.ponies) {
+        QStandardItem *item_icon = new QStandardItem(QIcon(QString("%1/%2/icon.png").arg(RuntimeConfig::settings().pony_directory, i->directory)),"");
         QStandardItem *item_text = new QStandardItem(i->directory);
 
         QList<QStandardItem*> row;
@@ -389,8 +591,9 @@ void ConfigWindow::load_settings()
     ui->effects_enabled->setChecked     (getSetting<bool>    ("general/effects-enabled", settings));
     ui->debug_enabled->setChecked(       getSetting<bool>    ("general/debug", settings));
     ui->show_advanced->setChecked(       getSetting<bool>    ("general/show-advanced", settings));
+    ui->animation_cache_size->setValue(  getSetting<int>     ("general/animation-cache-size", settings));
+    ui->overlay_mode->setChecked(        getSetting<bool>    ("general/overlay-mode", settings));
 
-    debug = getSetting<bool>("general/debug", settings);
 
     // Speech settings
     ui->speechenabled->setChecked(  getSetting<bool>    ("speech/enabled",settings));
@@ -413,6 +616,13 @@ void ConfigWindow::save_settings()
     bool change_bypass_wm = (getSetting<bool>("general/bypass-wm", settings) != ui->x11_bypass_wm->isChecked());
     bool reload_ponies = (getSetting<QString>("general/pony-directory", settings) != ui->ponydata_directory->text());
 
+    QHash<QString, QVariant> file_only;
+    for(const char *key: file_only_settings) {
+        if(settings.contains(key)) {
+            file_only.insert(key, settings.value(key));
+        }
+    }
+
     // Write the program settings
     settings.clear();
 
@@ -426,8 +636,9 @@ void ConfigWindow::save_settings()
     settings.setValue("effects-enabled", ui->effects_enabled->isChecked());
     settings.setValue("debug", ui->debug_enabled->isChecked());
     settings.setValue("show-advanced", ui->show_advanced->isChecked());
+    settings.setValue("animation-cache-size", ui->animation_cache_size->value());
+    settings.setValue("overlay-mode", ui->overlay_mode->isChecked());
 
-    debug = getSetting<bool>("debug", settings);
 
     settings.endGroup();
 
@@ -447,15 +658,35 @@ void ConfigWindow::save_settings()
 
     settings.endGroup();
 
+    for(auto i = file_only.constBegin(); i != file_only.constEnd(); ++i) {
+        settings.setValue(i.key(), i.value());
+    }
+
+    // Free effect windows still have the old window flags
+    if(change_ontop || change_bypass_wm) {
+        EffectWindowPool::instance().clear();
+    }
+
+    for(const auto &overlay : overlays) {
+        if(change_ontop) {
+            overlay->set_on_top(ui->alwaysontop->isChecked());
+        }
+        if(change_bypass_wm) {
+            overlay->set_bypass_wm(ui->x11_bypass_wm->isChecked());
+        }
+    }
+
     // Write the active ponies list
     settings.beginWriteArray("loaded-ponies");
     int i=0;
-    for(const auto &pony : ponies) {
-        if(change_ontop) {
-            pony->set_on_top(ui->alwaysontop->isChecked());
+    for(const auto &pony : simulation.ponies) {
+        // Ponies still being loaded get their windows with the new settings
+        PonyWindow *window = static_cast<PonyWindow*>(pony->view());
+        if(change_ontop && window != nullptr) {
+            window->set_on_top(ui->alwaysontop->isChecked());
         }
-        if(change_bypass_wm) {
-            pony->set_bypass_wm(ui->x11_bypass_wm->isChecked());
+        if(change_bypass_wm && window != nullptr) {
+            window->set_bypass_wm(ui->x11_bypass_wm->isChecked());
         }
         settings.setArrayIndex(i);
         settings.setValue("name", pony->directory);
@@ -469,113 +700,46 @@ void ConfigWindow::save_settings()
 
     // Make sure we write our changes to disk
     settings.sync();
+
+    publish_settings();
 }
 
-void ConfigWindow::update_distances()
+// Publish a snapshot of the settings used by the running ponies
+void ConfigWindow::publish_settings()
 {
-    distances.clear();
-    for(const std::shared_ptr<Pony> &p1: ponies) {
-        QPoint c1(p1->x_pos + p1->current_behavior->x_center, p1->y_pos + p1->current_behavior->y_center);
-        for(const std::shared_ptr<Pony> &p2: ponies) {
-            if(p1 == p2) continue;
+    QSettings settings;
+    RuntimeSettings s;
 
-            QPoint c2(p2->x_pos + p2->current_behavior->x_center, p2->y_pos + p2->current_behavior->y_center);
+    s.pony_directory       = getSetting<QString> ("general/pony-directory", settings);
+    s.always_on_top        = getSetting<bool>    ("general/always-on-top", settings);
+    s.bypass_wm            = getSetting<bool>    ("general/bypass-wm", settings);
+    s.interactions_enabled = getSetting<bool>    ("general/interactions-enabled", settings);
+    s.effects_enabled      = getSetting<bool>    ("general/effects-enabled", settings);
+    s.debug                = getSetting<bool>    ("general/debug", settings);
+    s.animation_cache_size = getSetting<int>     ("general/animation-cache-size", settings);
+    s.indexed_frames       = getSetting<bool>    ("general/indexed-frames", settings);
+    s.update_rate          = std::max(min_update_rate, std::min(max_update_rate, getSetting<int>("general/update-rate", settings)));
 
-            float dist = std::sqrt(std::pow(c2.x() - c1.x(), 2) + std::pow(c2.y() - c1.y(), 2));
+    s.speech_enabled       = getSetting<bool>    ("speech/enabled", settings);
+    s.speech_probability   = getSetting<float>   ("speech/probability", settings);
+    s.speech_duration      = getSetting<int>     ("speech/duration", settings);
 
-            distances.insert({{p1->name.toLower(), p2->name.toLower()}, dist});
-        }
-    }
+    s.sound_enabled        = getSetting<bool>    ("sound/enabled", settings);
+
+    RuntimeConfig::instance().publish(s);
 }
 
-void ConfigWindow::update_interactions()
-{
-    if(!getSetting<bool>("general/interactions-enabled")) return;
-
-    update_distances();
-
-    std::mt19937 gen(QDateTime::currentMSecsSinceEpoch());
-    std::uniform_real_distribution<> real_dis(0, 1);
-
-
-    // For each interaction
-    for(auto &i: interactions){
-        // check probability
-
-        // For each pony that starts this interaction
-        for(auto &p: ponies) {
-            if(p->name.toLower() != i.pony) continue;
-            if(p->in_interaction) continue;
-            if((p->interaction_delays.find(i.name) != p->interaction_delays.end()) && // Check if there is an active delay for this interaction in this pony
-                    (p->interaction_delays.at(i.name) > QDateTime::currentMSecsSinceEpoch())) continue;
-
-            // TODO: add it to interaction instance, and when cancelling, cancel interaction for every pony in interaction
-            std::vector<std::shared_ptr<Pony>> interaction_targets;
-
-            // For each target of that interaction
-            for(const QVariant &p_target: i.targets) {
-
-                // For each found target
-                for(auto &pp: ponies) {
-                    if(pp == p) continue; // Do not interact with self
-                    if(pp->name.toLower() != p_target.toString()) continue;
-
-                    if(pp->in_interaction){
-                        continue; // The pony is already in an interaction
-                    }else if(pp->sleeping){
-                        continue; // Sleeping ponies do not interact
-                    }else if(distances.at(std::make_pair(p->name.toLower(), p_target.toString())) > i.distance){
-                            continue; // The pony is too far, check the rest
-                    }else if((pp->interaction_delays.find(i.name) != pp->interaction_delays.end()) && // Check if there is an active delay for this interaction in this pony
-                                         (pp->interaction_delays.at(i.name) > QDateTime::currentMSecsSinceEpoch())) {
-                        continue; // The pony has an active delay for this interaction
-                    }else{
-                        // We found a suitable pony, we can do the interaction
-                        if(real_dis(gen) <= i.probability) {
-                            // Only interact with specified probability
-                            interaction_targets.push_back(pp);
-                        }
-                    }
-                }
-            }
-
-            if(interaction_targets.empty()) {
-                // We didn't find anypony to interact with, check the next initiating pony for this interaction
-                continue;
-            }
-
-            QString selected_behavior = i.select_behavior();
-
-            p->current_interaction = i.name;
-            p->current_interaction_delay = i.reactivation_delay;
-            p->in_interaction = true;
-            p->change_behavior_to(selected_behavior);
-
-            if(i.select_every_taget == false) { // Select random pony to interact with
-                std::uniform_int_distribution<> dis(0, interaction_targets.size()-1);
-                uint32_t rnd = dis(gen);
-
-                interaction_targets[rnd]->current_interaction = i.name;
-                interaction_targets[rnd]->current_interaction_delay = i.reactivation_delay;
-                interaction_targets[rnd]->in_interaction = true;
-                interaction_targets[rnd]->change_behavior_to(selected_behavior);
-                if(getSetting<bool>("general/debug")) {
-                    qDebug() << p->name << "interacting with" << interaction_targets[rnd]->name << "using behavior" << selected_behavior << "for interaction" << i.name;
-                }
-            }else{
-                // Interact with all suitable ponies
-                for(auto &t: interaction_targets) {
-                    t->current_interaction = i.name;
-                    t->current_interaction_delay = i.reactivation_delay;
-                    t->in_interaction = true;
-                    t->change_behavior_to(selected_behavior);
-                    if(getSetting<bool>("general/debug")) {
-                        qDebug() << p->name << " interacting with " << t->name << " using " << selected_behavior << " for interaction " << i.name;
-                    }
-                }
-            }
-        }
-    }
+// Apply the settings that are not read directly by the ponies
+void ConfigWindow::apply_settings()
+{
+    const RuntimeSettings &settings = RuntimeConfig::settings();
+
+    debug = settings.debug;
+    AnimationCache::instance().set_budget(static_cast<size_t>(settings.animation_cache_size) * 1024 * 1024);
+    AnimationCache::instance().set_indexed(settings.indexed_frames);
+
+    // Interactions may have been enabled
+    wake_up();
 }
 
 void ConfigWindow::show_debuglog()
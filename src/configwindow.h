@@ -31,28 +31,19 @@
 
 #include <memory>
 #include <vector>
+#include <deque>
 #include <unordered_map>
 
+#include "simulation.h"
 #include "pony.h"
-#include "interaction.h"
 
 namespace Ui {
     class ConfigWindow;
 }
 
 class DebugWindow;
-
-namespace std {
-    template <>
-    struct hash<pair<QString, QString> >
-    {
-        size_t operator()(const pair<QString, QString> &p) const
-        {
-            // Maybe change it so it gives the same hash for <p1,p2> and <p2,p1>
-            return qHash(QPair<QString, QString>(p.first, p.second));
-        }
-    };
-}
+class OverlayWindow;
+class PonyLoader;
 
 class ConfigWindow : public QMainWindow
 {
@@ -63,12 +54,26 @@ public:
     ~ConfigWindow();
 
 
-    std::list<std::shared_ptr<Pony>> ponies;
+    Simulation simulation;
     QTimer update_timer;
-    QTimer interaction_timer;
 
     static const std::unordered_map<QString, const QVariant> config_defaults;
 
+    // Where the compiled pony database is kept
+    static QString database_file();
+    // Where the images found to be mirrors of each other are remembered
+    static QString mirror_cache_file();
+    static uint64_t random_seed();
+    static ScreenLayout desktop_screens();
+    // Monotonic time in msec, used for the simulation and animations
+    static int64_t current_time();
+
+    // Are ponies still being loaded
+    bool is_loading() const;
+
+    // Number of updates in the last second
+    int wakeups_per_second() const;
+
     template <typename T>
     static T getSetting(const QString& name, const QSettings &settings = QSettings()) {
         QString key(name);
@@ -89,8 +94,14 @@ public:
 public slots:
     void remove_pony();
     void remove_pony_all();
+    // Update as soon as possible, after input changed what the ponies are doing
+    void wake_up();
 
 private slots:
+    void update_ponies();
+    void update_screens();
+    void pony_loaded(Pony *pony);
+    void ponies_loaded();
     void remove_pony_activelist();
     void newpony_list_changed(QModelIndex item);
     void add_pony();
@@ -98,18 +109,21 @@ private slots:
     void toggle_window(QSystemTrayIcon::ActivationReason reason);
     void save_settings();
     void load_settings();
+    void apply_settings();
     void lettertab_changed(int index);
     void change_ponydata_directory();
-    void update_interactions();
     void show_debuglog();
 
 private:
     void reload_available_ponies();
-    void update_distances();
-
-    std::vector<Interaction> interactions;
+    void load_pony(const QString &path);
+    void publish_settings();
+    void schedule_update(int64_t time);
+    // One overlay for every screen of the simulation, in overlay mode
+    void update_overlays();
 
-    std::unordered_map<std::pair<QString, QString>, float> distances;
+    std::vector<std::unique_ptr<OverlayWindow>> overlays;
+    PonyLoader *pony_loader;
 
     Ui::ConfigWindow *ui;
     std::unique_ptr<DebugWindow> ui_debug;
@@ -123,6 +137,14 @@ private:
     QAction *action_activeponies;
     QAction *action_configuration;
 
+    bool save_loaded_ponies;
+    bool startup_loading;
+
+    int64_t last_update;
+    int64_t next_update; // Time the update timer fires, if it is active
+    std::deque<int64_t> wakeups; // Times of the updates in the last second
+    int64_t next_wakeup_report;
+
 };
 
 #endif // CONFIGWINDOW_H
@@ -5,8 +5,21 @@
 #include <QString>
 #include <QList>
 #include <QVariant>
+#include <QHash>
 #include <unordered_map>
 
+namespace std
+{
+        template <>
+        struct hash<QString>
+        {
+            size_t operator()(const QString& s) const
+            {
+                return qHash(s);
+            }
+        };
+}
+
 class CSVParser {
 public:
     typedef std::vector<std::pair<std::string, QVariant::Type>> ParseTypes;
@@ -19,28 +19,21 @@
 #ifndef EFFECT_H
 #define EFFECT_H
 
-#include <QtGui/QMovie>
-#include <QtGui/QLabel>
-#include <QMainWindow>
 #include <QVariant>
-#include <QMovie>
 #include <QString>
 #include <QPoint>
+#include <QSize>
 
-#include <list>
-#include <string>
-#include <memory>
+#include <vector>
+#include <cstdint>
 
 #include "csv_parser.h"
 
-class Pony;
-class EffectInstance;
-
+// Effect as defined in pony.ini, shared by every instance of a pony.
 class Effect
 {
 public:
-    explicit Effect(Pony* parent, const QString filepath, const std::vector<QVariant> &options);
-    ~Effect();
+    explicit Effect(const QString filepath, const std::vector<QVariant> &options);
 
     enum Position {
         Top_Right       = 0,
@@ -57,25 +50,13 @@ public:
         Last            = 11
     };
 
-    void update();
-    void start();
-    void stop();
-    void change_direction(bool right);
-
     static const CSVParser::ParseTypes OptionTypes;
 
-    std::list<std::shared_ptr<EffectInstance>> instances;
-
     QString name;
     QString behavior;
 
-private:
-    void new_instance();
-
-    float duration;
-    float repeat_delay;
-    int64_t last_instanced;
-    bool running;
+    float duration;     // Duration = 0 means the effect stays there until its stoped
+    float repeat_delay; // repeat_delay = 0 means we spawn only one instance
 
     QString image_left;
     QString image_right;
@@ -85,38 +66,20 @@ private:
     Position center_right;
     Position center_left;
     bool follow;
-
-    Pony* parent_pony;
-
-    friend class EffectInstance;
-
 };
 
-class EffectInstance: public QMainWindow
+// One spawned copy of an effect, as simulated by its Pony
+class EffectInstance
 {
-    Q_OBJECT
 public:
-    explicit EffectInstance(Effect* owner, int64_t started, bool right, QWidget *parent = 0);
-    ~EffectInstance();
-
-    void change_direction(bool right);
-    void update_animation();
-
+    const Effect *effect;
     int64_t time_started;
-    QPoint offset;
-
-private:
-    QPoint get_location(int location, int centering);
-
-    QMovie* animation_left;
-    QMovie* animation_right;
-    QMovie* current_animation;
-
-    int image_width;
-    int image_height;
+    bool right;
 
-    QLabel label;
-    Effect* owner;
+    QString image;   // Displayed image file, relative to the pony directory
+    QSize size;      // Size of that image
+    QPoint offset;   // Relative to the top left corner of the pony
+    QPoint position; // Top left corner on the screen
 };
 
 
@@ -1,6 +1,5 @@
 #include "interaction.h"
 
-#include <QDateTime>
 #include <QDebug>
 
 #include <random>
@@ -51,9 +50,8 @@ Interaction::Interaction(const std::vector<QVariant> &options)
     reactivation_delay = options[7].toInt() * 1000; // We use time in msec
 }
 
-const QString Interaction::select_behavior()
+const QString Interaction::select_behavior(Random &gen) const
 {
-    std::mt19937 gen(QDateTime::currentMSecsSinceEpoch());
     std::uniform_int_distribution<> dis(0, behaviors.count()-1);
     return behaviors[dis(gen)].toString();
 }
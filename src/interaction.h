@@ -7,6 +7,7 @@
 #include <vector>
 
 #include "csv_parser.h"
+#include "random.h"
 
 class Interaction
 {
@@ -15,7 +16,7 @@ public:
 
     static const CSVParser::ParseTypes OptionTypes;
 
-    const QString select_behavior();
+    const QString select_behavior(Random &gen) const;
 
     QString name;
     QString pony;
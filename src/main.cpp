@@ -29,6 +29,7 @@
 #include "speak.h"
 
 #include "configwindow.h"
+#include "ponydatabase.h"
 #include "pony.h"
 
 int main(int argc, char *argv[])
@@ -52,6 +53,13 @@ int main(int argc, char *argv[])
     app.setQuitOnLastWindowClosed(false);
     QSettings::setDefaultFormat(QSettings::IniFormat);
 
+    // qt-ponies --compile-database [pony directory]
+    // Compile the pony data ahead of time, instead of on the first start after it changed
+    if(app.arguments().size() > 1 && app.arguments().at(1) == "--compile-database") {
+        QString pony_directory = app.arguments().size() > 2 ? app.arguments().at(2) : ConfigWindow::getSetting<QString>("general/pony-directory");
+        return PonyDatabase::compile(pony_directory, ConfigWindow::database_file()) ? 0 : 1;
+    }
+
     QFile qss(":/styles/res/style.qss");
     qss.open(QFile::ReadOnly);
     app.setStyleSheet( QString::fromUtf8(qss.readAll()) );
@@ -61,7 +69,8 @@ int main(int argc, char *argv[])
 
     qDebug() << "Locale:" << locale;
 
-    if(config.ponies.size() == 0) {
+    // Without saved ponies, show the configuration so somepony can be added
+    if(config.simulation.ponies.size() == 0 && !config.is_loading()) {
         config.show();
     }
 
@@ -0,0 +1,152 @@
+/*
+ * Qt-ponies - ponies on the desktop
+ * Copyright (C) 2012 mysha
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <QFile>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QDataStream>
+#include <QMutexLocker>
+#include <QDebug>
+
+#include "mirrorcache.h"
+
+static const quint32 mirrors_magic = 0x4d495252; // "MIRR"
+static const quint32 mirrors_version = 1;
+
+static qint64 modification_time(const QString &path)
+{
+    QFileInfo info(path);
+    return info.exists() ? info.lastModified().toMSecsSinceEpoch() : -1;
+}
+
+MirrorCache::MirrorCache()
+    : changed(false)
+{
+}
+
+MirrorCache& MirrorCache::instance()
+{
+    static MirrorCache cache;
+    return cache;
+}
+
+void MirrorCache::open(const QString &new_file)
+{
+    QMutexLocker lock(&mutex);
+
+    file = new_file;
+    entries.clear();
+    changed = false;
+
+    QFile ifile(file);
+    if(!ifile.open(QIODevice::ReadOnly)) return;
+
+    QDataStream in(&ifile);
+    in.setVersion(QDataStream::Qt_4_7);
+
+    quint32 magic;
+    quint32 version;
+    quint32 count;
+    in >> magic >> version >> count;
+    if(in.status() != QDataStream::Ok || magic != mirrors_magic || version != mirrors_version) return;
+
+    for(quint32 i = 0; i < count; i++) {
+        QString key;
+        Entry entry;
+        in >> key >> entry.first_time >> entry.second_time >> entry.mirrored;
+        if(in.status() != QDataStream::Ok) {
+            // Only a part of the file is usable, it is written again on save()
+            changed = true;
+            break;
+        }
+        entries.insert(key, entry);
+    }
+}
+
+void MirrorCache::save()
+{
+    QMutexLocker lock(&mutex);
+    if(!changed || file.isEmpty()) return;
+
+    // Write to a temporary file first, so the old results stay usable if writing fails
+    QString temporary = file + ".tmp";
+    QFile ofile(temporary);
+    if(!ofile.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qWarning() << "Cannot write mirror cache" << temporary << ofile.errorString();
+        return;
+    }
+
+    QDataStream out(&ofile);
+    out.setVersion(QDataStream::Qt_4_7);
+    out << mirrors_magic << mirrors_version << static_cast<quint32>(entries.size());
+    for(auto i = entries.constBegin(); i != entries.constEnd(); ++i) {
+        out << i.key() << i->first_time << i->second_time << i->mirrored;
+    }
+    ofile.close();
+
+    if(out.status() != QDataStream::Ok || ofile.error() != QFile::NoError) {
+        qWarning() << "Cannot write mirror cache" << temporary;
+        QFile::remove(temporary);
+        return;
+    }
+
+    QFile::remove(file);
+    if(!QFile::rename(temporary, file)) {
+        qWarning() << "Cannot write mirror cache" << file;
+        QFile::remove(temporary);
+        return;
+    }
+
+    changed = false;
+}
+
+MirrorCache::Result MirrorCache::lookup(const QString &a, const QString &b) const
+{
+    const QString &first = a < b ? a : b;
+    const QString &second = a < b ? b : a;
+
+    const qint64 first_time = modification_time(first);
+    const qint64 second_time = modification_time(second);
+
+    QMutexLocker lock(&mutex);
+
+    auto found = entries.find(QString("%1\n%2").arg(first, second));
+    if(found == entries.end()) return Unknown;
+
+    // Compared before one of them changed
+    if(found->first_time != first_time || found->second_time != second_time) {
+        return Unknown;
+    }
+
+    return found->mirrored ? Mirrored : Different;
+}
+
+void MirrorCache::record(const QString &a, const QString &b, bool mirrored)
+{
+    const QString &first = a < b ? a : b;
+    const QString &second = a < b ? b : a;
+
+    Entry entry;
+    entry.first_time = modification_time(first);
+    entry.second_time = modification_time(second);
+    entry.mirrored = mirrored;
+
+    QMutexLocker lock(&mutex);
+    entries.insert(QString("%1\n%2").arg(first, second), entry);
+    changed = true;
+}
@@ -0,0 +1,64 @@
+/*
+ * Qt-ponies - ponies on the desktop
+ * Copyright (C) 2012 mysha
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MIRRORCACHE_H
+#define MIRRORCACHE_H
+
+#include <QString>
+#include <QHash>
+#include <QMutex>
+
+#include <cstdint>
+
+// Remembers which pairs of left and right images are horizontal mirrors of each other, so
+// the right one can be drawn from the frames of the left one without decoding it.
+// Results are kept in a file, with the modification times of both images. A pair is only
+// compared again when one of its images changed.
+class MirrorCache
+{
+public:
+    enum Result { Unknown, Mirrored, Different };
+
+    static MirrorCache& instance();
+
+    // Read the results from 'file', they are written back to it by save()
+    void open(const QString &file);
+    // Write the results to the file, if any changed since it was opened
+    void save();
+
+    Result lookup(const QString &a, const QString &b) const;
+    void record(const QString &a, const QString &b, bool mirrored);
+
+private:
+    MirrorCache();
+    MirrorCache(const MirrorCache&) = delete;
+    MirrorCache& operator=(const MirrorCache&) = delete;
+
+    struct Entry {
+        qint64 first_time;  // Modification times of the images when they were compared
+        qint64 second_time;
+        bool mirrored;
+    };
+
+    mutable QMutex mutex;
+    QString file;
+    QHash<QString, Entry> entries; // Both paths, in order, separated by a newline
+    bool changed;
+};
+
+#endif // MIRRORCACHE_H
@@ -0,0 +1,170 @@
+/*
+ * Qt-ponies - ponies on the desktop
+ * Copyright (C) 2012 mysha
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <cmath>
+
+#include "movementkernel.h"
+#include "pony.h"
+
+int MovementKernel::add(Pony *owner, float new_x, float new_y)
+{
+    owners.push_back(owner);
+    x.push_back(new_x);
+    y.push_back(new_y);
+    vel_x.push_back(0);
+    vel_y.push_back(0);
+    speed.push_back(0);
+    dir_x.push_back(1);
+    dir_y.push_back(1);
+    min_x.push_back(new_x);
+    max_x.push_back(new_x);
+    min_y.push_back(new_y);
+    max_y.push_back(new_y);
+    dest_x.push_back(0);
+    dest_y.push_back(0);
+    mode.push_back(Stopped);
+    stopped.push_back(0);
+    events.push_back(0);
+
+    return owners.size() - 1;
+}
+
+void MovementKernel::remove(int slot)
+{
+    const int last = owners.size() - 1;
+
+    if(slot != last) {
+        owners[slot]  = owners[last];
+        x[slot]       = x[last];
+        y[slot]       = y[last];
+        vel_x[slot]   = vel_x[last];
+        vel_y[slot]   = vel_y[last];
+        speed[slot]   = speed[last];
+        dir_x[slot]   = dir_x[last];
+        dir_y[slot]   = dir_y[last];
+        min_x[slot]   = min_x[last];
+        max_x[slot]   = max_x[last];
+        min_y[slot]   = min_y[last];
+        max_y[slot]   = max_y[last];
+        dest_x[slot]  = dest_x[last];
+        dest_y[slot]  = dest_y[last];
+        mode[slot]    = mode[last];
+        stopped[slot] = stopped[last];
+        events[slot]  = events[last];
+
+        owners[slot]->movement_slot = slot;
+    }
+
+    owners.pop_back();
+    x.pop_back();
+    y.pop_back();
+    vel_x.pop_back();
+    vel_y.pop_back();
+    speed.pop_back();
+    dir_x.pop_back();
+    dir_y.pop_back();
+    min_x.pop_back();
+    max_x.pop_back();
+    min_y.pop_back();
+    max_y.pop_back();
+    dest_x.pop_back();
+    dest_y.pop_back();
+    mode.pop_back();
+    stopped.pop_back();
+    events.pop_back();
+}
+
+int MovementKernel::size() const
+{
+    return owners.size();
+}
+
+void MovementKernel::update(float step)
+{
+    const int n = owners.size();
+
+    float *const px = x.data();
+    float *const py = y.data();
+    float *const vx = vel_x.data();
+    float *const vy = vel_y.data();
+    uint8_t *const ev = events.data();
+
+    // Ponies moving with a constant velocity bounce off the screen edges, if they are not already going away from them
+    for(int i = 0; i < n; i++) {
+        const bool linear = mode[i] == Linear;
+        ev[i] = ((linear && px[i] <= min_x[i] && dir_x[i] != 1.0f)  ? BounceLeft   : 0) |
+                ((linear && px[i] >= max_x[i] && dir_x[i] != -1.0f) ? BounceRight  : 0) |
+                ((linear && py[i] <= min_y[i] && dir_y[i] != 1.0f)  ? BounceTop    : 0) |
+                ((linear && py[i] >= max_y[i] && dir_y[i] != -1.0f) ? BounceBottom : 0);
+    }
+
+    // Ponies moving to a point go straight there, but do not leave the screen
+    for(int i = 0; i < n; i++) {
+        if(mode[i] != ToPoint) continue;
+
+        const float dx = dest_x[i] - px[i];
+        const float dy = dest_y[i] - py[i];
+
+        if(std::abs(dx) < 1.5f && std::abs(dy) < 1.5f) {
+            ev[i] = Arrived;
+            vx[i] = vy[i] = 0;
+            continue;
+        }
+
+        if(dest_x[i] == 0 && dest_y[i] == 0) {
+            ev[i] = NoTarget;
+            vx[i] = vy[i] = 0;
+            continue;
+        }
+
+        const float len = std::sqrt(dx*dx + dy*dy);
+        const float ux = dx / len;
+        const float uy = dy / len;
+
+        if((ux < 0 && dir_x[i] != -1.0f) || (ux > 0 && dir_x[i] != 1.0f) || stopped[i]) {
+            ev[i] = Turn;
+        }
+
+        // Long steps stop at the destination instead of going past it
+        const float v = std::min(speed[i], len / step);
+
+        vx[i] = ((ux < 0 && px[i] >= min_x[i]) || (ux > 0 && px[i] <= max_x[i])) ? ux * v : 0.0f;
+        vy[i] = ((uy < 0 && py[i] >= min_y[i]) || (uy > 0 && py[i] <= max_y[i])) ? uy * v : 0.0f;
+    }
+
+    // Let the ponies react, which may change their velocities and bounds
+    for(int i = 0; i < n; i++) {
+        if(ev[i] != 0) {
+            owners[i]->movement_events(ev[i]);
+        }
+    }
+
+    // Stopped ponies have no velocity, so everypony can be moved in the same way
+    for(int i = 0; i < n; i++) {
+        px[i] += vx[i] * step;
+        py[i] += vy[i] * step;
+    }
+
+    // Ponies held at a screen edge or waiting for their target did not move, nothing attached to them has to follow
+    for(int i = 0; i < n; i++) {
+        if(mode[i] != Stopped && (ev[i] & (Arrived | NoTarget)) == 0 && (vx[i] != 0.0f || vy[i] != 0.0f)) {
+            owners[i]->moved();
+        }
+    }
+}
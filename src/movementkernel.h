@@ -0,0 +1,86 @@
+/*
+ * Qt-ponies - ponies on the desktop
+ * Copyright (C) 2012 mysha
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MOVEMENTKERNEL_H
+#define MOVEMENTKERNEL_H
+
+#include <vector>
+#include <cstdint>
+
+class Pony;
+
+// Positions and velocities of every pony, kept in contiguous arrays and advanced in one pass per tick.
+//
+// The arrays are filled by the ponies when their behavior, direction or screen changes. A tick first
+// finds the ponies that reached a screen edge or their destination, lets those ponies react
+// (turn around, choose a new angle, stop), then moves everypony and tells the moved ones.
+//
+// Speeds are given in pixels per reference tick of 30 msec, like Behavior::speed in pony.ini.
+// Ponies move by the time that passed, so the tick rate does not change how fast they go.
+class MovementKernel
+{
+public:
+    enum Mode {
+        Stopped     = 0,
+        Linear      = 1, // Constant velocity, bouncing off the screen edges
+        ToPoint     = 2  // Towards the destination point, stopping at the screen edges
+    };
+
+    enum Event {
+        BounceLeft      = 1 << 0,
+        BounceRight     = 1 << 1,
+        BounceTop       = 1 << 2,
+        BounceBottom    = 1 << 3,
+        Arrived         = 1 << 4,
+        Turn            = 1 << 5, // Not facing the destination, or starting to move again after arriving
+        NoTarget        = 1 << 6
+    };
+
+    // Returns the slot of the new pony
+    int add(Pony *owner, float x, float y);
+    // The last pony is moved into the removed slot
+    void remove(int slot);
+    int size() const;
+
+    // Length of the tick speeds are given for, in msec
+    static const int reference_tick = 30;
+
+    // Move everypony by 'step' reference ticks
+    void update(float step);
+
+    std::vector<Pony*> owners;
+
+    std::vector<float> x;       // Center of the pony
+    std::vector<float> y;
+    std::vector<float> vel_x;   // Pixels per reference tick. Set by the pony in Linear mode, computed every tick in ToPoint mode
+    std::vector<float> vel_y;
+    std::vector<float> speed;
+    std::vector<float> dir_x;   // Direction the pony is facing, -1 or 1
+    std::vector<float> dir_y;
+    std::vector<float> min_x;   // Range of the center which keeps the whole image on the screen
+    std::vector<float> max_x;
+    std::vector<float> min_y;
+    std::vector<float> max_y;
+    std::vector<float> dest_x;
+    std::vector<float> dest_y;
+    std::vector<uint8_t> mode;
+    std::vector<uint8_t> stopped; // Arrived at the destination
+    std::vector<uint8_t> events;
+};
+
+#endif // MOVEMENTKERNEL_H
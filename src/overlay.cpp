@@ -0,0 +1,317 @@
+/*
+ * Qt-ponies - ponies on the desktop
+ * Copyright (C) 2012 mysha
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <QPainter>
+#include <QPaintEvent>
+#include <QMouseEvent>
+#include <QVector>
+
+#include <vector>
+
+#include "configwindow.h"
+#include "runtimeconfig.h"
+#include "overlay.h"
+#include "ponywindow.h"
+
+#ifdef Q_WS_X11
+ #include <QX11Info>
+ #include <X11/Xatom.h>
+ #include <X11/Xlib.h> // Xlib #defines None as 0L, which conflicts with Behavior::Movement::None
+ #include <X11/extensions/Xfixes.h>
+ #include <X11/extensions/shapeconst.h>
+#endif
+
+static bool overlay_active = false;
+
+static PonyWindow* window_of(const std::shared_ptr<Pony> &pony)
+{
+    return static_cast<PonyWindow*>(pony->view());
+}
+
+OverlayWindow::OverlayWindow(ConfigWindow *config, const QRect &geometry, QWidget *parent)
+    : QWidget(parent), config(config)
+{
+    // Set window properties the same as the pony window
+    setAttribute(Qt::WA_TranslucentBackground, true);
+    setAttribute(Qt::WA_ShowWithoutActivating);
+    setMouseTracking(true);
+
+#ifdef Q_WS_X11
+    // Disables shadows under the overlay window.
+    setAttribute(Qt::WA_X11NetWmWindowTypeDock);
+#endif
+
+#if defined QT_MAC_USE_COCOA && QT_VERSION >= 0x040800
+    // Removes shadows that lag behind animation on OS X. QT 4.8+ needed.
+    setAttribute(Qt::WA_MacNoShadow, true);
+#endif
+
+#ifdef QT_MAC_USE_COCOA
+    // On OS X, tool windows are hidden when another program gains focus.
+    Qt::WindowFlags windowflags = Qt::FramelessWindowHint;
+#else
+    Qt::WindowFlags windowflags = Qt::FramelessWindowHint | Qt::Tool;
+#endif
+
+    if(RuntimeConfig::settings().always_on_top) {
+        windowflags |= Qt::WindowStaysOnTopHint;
+    }
+
+#ifdef Q_WS_X11
+    if(RuntimeConfig::settings().bypass_wm) {
+        // Bypass the window manager
+        windowflags |= Qt::X11BypassWindowManagerHint;
+    }
+#endif
+
+    setWindowFlags( windowflags );
+    setGeometry(geometry);
+
+    set_window_state();
+
+    // Nothing is drawn yet, so let all input through
+    set_input_region(QRegion());
+
+    show();
+}
+
+OverlayWindow::~OverlayWindow()
+{
+}
+
+bool OverlayWindow::active()
+{
+    return overlay_active;
+}
+
+void OverlayWindow::set_active(bool enabled)
+{
+    overlay_active = enabled;
+}
+
+void OverlayWindow::set_on_top(bool top)
+{
+    Qt::WindowFlags windowflags = windowFlags();
+    if(top == true){
+        windowflags |= Qt::WindowStaysOnTopHint; // Enable always on top
+    }else{
+        windowflags &= ~Qt::WindowStaysOnTopHint; // Disable always on top
+    }
+
+    // Changing the window flags recreates the window, so we have to set everything again
+    setWindowFlags(windowflags);
+    set_window_state();
+    set_input_region(input_region);
+    show();
+}
+
+void OverlayWindow::set_bypass_wm(bool bypass)
+{
+    Qt::WindowFlags windowflags = windowFlags();
+    if(bypass == true) {
+        windowflags |= Qt::X11BypassWindowManagerHint;
+    }else{
+        windowflags &= ~Qt::X11BypassWindowManagerHint;
+    }
+
+    setWindowFlags(windowflags);
+    set_window_state();
+    set_input_region(input_region);
+    show();
+}
+
+void OverlayWindow::set_screen_geometry(const QRect &geometry)
+{
+    if(geometry == this->geometry()) return;
+
+    setGeometry(geometry);
+
+    // The painted region was relative to the old position, everything is drawn again on the next tick
+    painted = QRegion();
+    set_input_region(QRegion());
+    update();
+}
+
+void OverlayWindow::set_window_state()
+{
+#ifdef Q_WS_X11
+    // Qt on X11 does not support the skip taskbar/pager window flags, we have to set them ourselves
+    Atom window_state = XInternAtom( QX11Info::display(), "_NET_WM_STATE", False );
+    Atom window_props[] = {
+        XInternAtom( QX11Info::display(), "_NET_WM_STATE_SKIP_TASKBAR", False ),
+        XInternAtom( QX11Info::display(), "_NET_WM_STATE_SKIP_PAGER"  , False ),
+        XInternAtom( QX11Info::display(), "_NET_WM_STATE_ABOVE", False )
+    };
+
+    int props = (windowFlags() & Qt::WindowStaysOnTopHint) ? 3 : 2;
+    XChangeProperty( QX11Info::display(), winId(), window_state, XA_ATOM, 32, PropModeReplace, (unsigned char*)&window_props, props );
+#endif
+}
+
+// Limit the area of the overlay that receives mouse events
+void OverlayWindow::set_input_region(const QRegion &region)
+{
+    input_region = region;
+
+#ifdef Q_WS_X11
+    QVector<QRect> rects = region.rects();
+    std::vector<XRectangle> xrects(rects.size());
+    for(int i = 0; i < rects.size(); i++) {
+        xrects[i].x = rects[i].x();
+        xrects[i].y = rects[i].y();
+        xrects[i].width = rects[i].width();
+        xrects[i].height = rects[i].height();
+    }
+
+    XserverRegion shape_region = XFixesCreateRegion(QX11Info::display(), xrects.data(), xrects.size());
+    XFixesSetWindowShapeRegion(QX11Info::display(), winId(), ShapeInput, 0, 0, shape_region);
+    XFixesDestroyRegion(QX11Info::display(), shape_region);
+#else
+    // Without input shapes the window mask limits both input and drawing.
+    // An empty mask would remove the mask, so use a single pixel instead.
+    setMask(region.isEmpty() ? QRegion(0, 0, 1, 1) : region);
+#endif
+}
+
+// Called on every tick of the update timer, after all the ponies moved
+void OverlayWindow::update_sprites()
+{
+    QRegion current;
+    QRegion ponies_region;
+
+    for(auto &i: config->simulation.ponies) {
+        PonyWindow *window = window_of(i);
+        if(window == nullptr) continue; // Still loading
+
+        current += window->painted_region();
+        ponies_region += window->geometry();
+    }
+
+    current.translate(-pos());
+    current &= rect();
+    ponies_region.translate(-pos());
+    ponies_region &= rect();
+
+    // Erase the sprites at their old positions and draw them at the new ones
+    update(current | painted);
+    painted = current;
+
+#ifdef Q_WS_X11
+    // Effects and speech do not take input, same as their windows in normal mode
+    if(ponies_region != input_region) {
+        set_input_region(ponies_region);
+    }
+#else
+    if(current != input_region) {
+        set_input_region(current);
+    }
+#endif
+}
+
+void OverlayWindow::paintEvent(QPaintEvent *event)
+{
+    QPainter painter(this);
+
+    QRect dirty = event->region().boundingRect().translated(pos());
+    for(auto &i: config->simulation.ponies) {
+        PonyWindow *window = window_of(i);
+        if(window != nullptr && window->painted_region().boundingRect().intersects(dirty)) {
+            window->paint(painter, pos());
+        }
+    }
+}
+
+// Topmost pony at the given position, the last one drawn is on top
+PonyWindow* OverlayWindow::pony_at(const QPoint &global_pos)
+{
+    for(auto i = config->simulation.ponies.rbegin(); i != config->simulation.ponies.rend(); ++i) {
+        PonyWindow *window = window_of(*i);
+        if(window != nullptr && window->geometry().contains(global_pos)) {
+            return window;
+        }
+    }
+    return nullptr;
+}
+
+void OverlayWindow::set_hovered(PonyWindow *pony)
+{
+    if(pony == hovered) return;
+
+    if(!hovered.isNull()) {
+        QEvent leave(QEvent::Leave);
+        hovered->leaveEvent(&leave);
+    }
+
+    hovered = pony;
+
+    if(!hovered.isNull()) {
+        QEvent enter(QEvent::Enter);
+        hovered->enterEvent(&enter);
+    }
+}
+
+void OverlayWindow::mouseMoveEvent(QMouseEvent *event)
+{
+    PonyWindow *pony = grabbed;
+    if(pony == nullptr) {
+        pony = pony_at(event->globalPos());
+        set_hovered(pony);
+    }
+
+    if(pony != nullptr) {
+        QMouseEvent e(event->type(), pony->mapFromGlobal(event->globalPos()), event->globalPos(), event->button(), event->buttons(), event->modifiers());
+        pony->mouseMoveEvent(&e);
+    }
+}
+
+void OverlayWindow::mousePressEvent(QMouseEvent *event)
+{
+    PonyWindow *pony = pony_at(event->globalPos());
+    if(pony == nullptr) return;
+
+    if(event->button() == Qt::RightButton) {
+        // Pony windows use a custom context menu
+        pony->display_menu(pony->mapFromGlobal(event->globalPos()));
+        return;
+    }
+
+    grabbed = pony;
+    QMouseEvent e(event->type(), pony->mapFromGlobal(event->globalPos()), event->globalPos(), event->button(), event->buttons(), event->modifiers());
+    pony->mousePressEvent(&e);
+}
+
+void OverlayWindow::mouseReleaseEvent(QMouseEvent *event)
+{
+    if(grabbed.isNull()) return;
+
+    PonyWindow *pony = grabbed;
+    if(event->buttons() == Qt::NoButton) {
+        grabbed = nullptr;
+    }
+
+    QMouseEvent e(event->type(), pony->mapFromGlobal(event->globalPos()), event->globalPos(), event->button(), event->buttons(), event->modifiers());
+    pony->mouseReleaseEvent(&e);
+}
+
+void OverlayWindow::leaveEvent(QEvent *event)
+{
+    if(grabbed.isNull()) {
+        set_hovered(nullptr);
+    }
+    event->accept();
+}
@@ -0,0 +1,76 @@
+/*
+ * Qt-ponies - ponies on the desktop
+ * Copyright (C) 2012 mysha
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef OVERLAY_H
+#define OVERLAY_H
+
+#include <QWidget>
+#include <QRegion>
+#include <QPointer>
+
+class ConfigWindow;
+class PonyWindow;
+
+// Fullscreen translucent window covering one screen, that draws every pony,
+// effect and speech bubble on that screen in a single paint pass.
+// Used instead of one window per pony/effect/speech when overlay mode is enabled.
+// Pony and effect windows still exist for their geometry, but are never shown.
+//
+// The overlay only accepts input over the ponies, and forwards the mouse events
+// to the pony under the cursor.
+class OverlayWindow : public QWidget
+{
+    Q_OBJECT
+public:
+    // 'geometry' is the screen covered, from the ScreenLayout of the simulation
+    explicit OverlayWindow(ConfigWindow *config, const QRect &geometry, QWidget *parent = 0);
+    ~OverlayWindow();
+
+    // Overlay mode is selected at startup, and can not be changed while running
+    static bool active();
+    static void set_active(bool enabled);
+
+    void set_on_top(bool top);
+    void set_bypass_wm(bool bypass);
+    // Cover the screen again after its resolution or position changed
+    void set_screen_geometry(const QRect &geometry);
+
+public slots:
+    void update_sprites();
+
+protected:
+    void paintEvent(QPaintEvent *event);
+    void mouseMoveEvent(QMouseEvent *event);
+    void mousePressEvent(QMouseEvent *event);
+    void mouseReleaseEvent(QMouseEvent *event);
+    void leaveEvent(QEvent *event);
+
+private:
+    PonyWindow* pony_at(const QPoint &global_pos);
+    void set_hovered(PonyWindow *pony);
+    void set_window_state();
+    void set_input_region(const QRegion &region);
+
+    ConfigWindow *config;
+    QRegion painted;
+    QRegion input_region;
+    QPointer<PonyWindow> hovered; // Pony under the mouse cursor
+    QPointer<PonyWindow> grabbed; // Pony receiving mouse events while a button is pressed
+};
+
+#endif // OVERLAY_H
@@ -16,404 +16,149 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
-#include <QApplication>
-#include <QDesktopWidget>
 #include <QString>
-#include <QDateTime>
-#include <QMenu>
-#include <QCheckBox>
-#include <QWidgetAction>
-#include <QFile>
-#include <QTextStream>
+#include <QRect>
 #include <QDebug>
 
-#include <fstream>
 #include <random>
 #include <algorithm>
 #include <utility>
 
 #include <cmath>
 
-#include "csv_parser.h"
-#include "configwindow.h"
+#include "runtimeconfig.h"
+#include "ponytemplate.h"
+#include "simulation.h"
 #include "pony.h"
 
-#ifdef Q_WS_X11
- #include <QX11Info>
- #include <X11/Xatom.h>
- #include <X11/Xlib.h> // Xlib #defines None as 0L, which conflicts with Behavior::Movement::None
-                       // This is why we include it after pony.h
-#endif
-
-// TODO: Maybe a configuration option to change window shape?
-// connect to current_animation: update() signal and do:
-// setMask(current_behavior->current_animation->currentPixmap().mask());
-// or maybe there are better ways to do it
-
-// NOTE: QMovie in separate thread?
-
-// FIXME: when ponies are not on top, they (all at once) flicker to top sometimes (on text show?)
-
-Pony::Pony(const QString path, ConfigWindow *config, QWidget *parent) :
-    QMainWindow(parent), sleeping(false), in_interaction(false), current_interaction_delay(0), gen(QDateTime::currentMSecsSinceEpoch()), label(this), config(config), dragging(false), mouseover(false)
+Pony::Pony(const QString &path, Simulation *simulation) :
+    current_behavior(nullptr), sleeping(false), dragging(false), mouseover(false), speaking(false), speech_line(nullptr), speech_started(0),
+    in_interaction(false), current_interaction_delay(0), gen(simulation->new_random()),
+    simulation(simulation), kernel(&simulation->movement_kernel), movement_slot(-1), tick_slot(-1), old_behavior(nullptr),
+    movement(Behavior::Movement::None), moving(true), angle(0), animation(0)
 {
-    setAttribute(Qt::WA_TranslucentBackground, true);
-    setAttribute(Qt::WA_ShowWithoutActivating);
-
-#ifdef Q_WS_X11
-    // Disables shadows under the pony window.
-    // We do not set this attribute for the label, because it looks better with a shadow.
-    setAttribute(Qt::WA_X11NetWmWindowTypeDock);
-#endif
-
-#if defined QT_MAC_USE_COCOA && QT_VERSION >= 0x040800
-    // Removes shadows that lag behind animation on OS X. QT 4.8+ needed.
-    setAttribute(Qt::WA_MacNoShadow, true);
-#endif
-
-#ifdef QT_MAC_USE_COCOA
-    // On OS X, tool windows are hidden when another program gains focus.
-    Qt::WindowFlags windowflags = Qt::FramelessWindowHint;
-#else
-    Qt::WindowFlags windowflags = Qt::FramelessWindowHint | Qt::Tool;
-#endif
-
-    always_on_top = config->getSetting<bool>("general/always-on-top");
-    if(always_on_top) {
-        windowflags |= Qt::WindowStaysOnTopHint;
-    }
-
-#ifdef Q_WS_X11
-    if(config->getSetting<bool>("general/bypass-wm")) {
-        // Bypass the window manager
-        windowflags |= Qt::X11BypassWindowManagerHint;
-    }
-#endif
-
-    setWindowFlags( windowflags );
-
-#ifdef Q_WS_X11
-    // Qt on X11 does not support the skip taskbar/pager window flags, we have to set them ourselves
-    // We let Qt initialize the other window properties, which aren't deleted when we replace them with ours
-    // (they probably are appended on show())
-    Atom window_state = XInternAtom( QX11Info::display(), "_NET_WM_STATE", False );
-    Atom window_props[] = {
-        XInternAtom( QX11Info::display(), "_NET_WM_STATE_SKIP_TASKBAR", False ),
-        XInternAtom( QX11Info::display(), "_NET_WM_STATE_SKIP_PAGER"  , False )
-    };
-
-    XChangeProperty( QX11Info::display(), window()->winId(), window_state, XA_ATOM, 32, PropModeReplace, (unsigned char*)&window_props, 2 );
-#endif
-
-    setContextMenuPolicy(Qt::CustomContextMenu);
-    connect(this, SIGNAL(customContextMenuRequested(const QPoint &)), this, SLOT(display_menu(const QPoint &)));
-
-    // Setup speech label
-    text_label.hide();
-    text_label.setAttribute(Qt::WA_ShowWithoutActivating);
-    text_label.setWindowFlags(windowflags);
-    text_label.setAlignment(Qt::AlignHCenter);
-    text_label.setSizePolicy(QSizePolicy::Preferred, QSizePolicy::Preferred);
-
-    // Initially place the pony randomly on the screen, keeping a 50 pixel border
-    x_pos = 50 + gen()%(QApplication::desktop()->availableGeometry(this).width()-100);
-    y_pos = 50 + gen()%(QApplication::desktop()->availableGeometry(this).height()-100);
-
-    move(x_pos, y_pos);
-
     directory = path;
 
-    QFile ifile(QString("%1/%2/pony.ini").arg(ConfigWindow::getSetting<QString>("general/pony-directory"), path));
-    if(!ifile.open(QIODevice::ReadOnly | QIODevice::Text)) {
-        qCritical() << "Cannot open pony.ini for pony:"<< path;
-        qCritical() << ifile.errorString();
-        throw std::exception();
-    }
-
-    name = path;
-
-    if( ifile.isOpen() ) {
-        QString line;
-        QTextStream istr(&ifile);
-
-        while (!istr.atEnd() ) {
-            line = istr.readLine();
-
-            if(line[0] != '\'' && !line.isEmpty()) {
-                std::vector<QVariant> csv_data;
-                CSVParser::ParseLine(csv_data, line, ',');
-
-                // TODO: maybe add a try/catch here, in case of malformed pony.ini lines
-                if(csv_data[0] == "Name") {
-                    name = csv_data[1].toString(); //Name,"name"
-                }
-                else if(csv_data[0] == "Behavior") {
-                    Behavior b(this, path, csv_data);
-                    behaviors.insert({b.name, std::move(b)});
-                }
-                else if(csv_data[0] == "Effect") {
-                    Effect e(this, path, csv_data);
-                    effects.insert({e.name, std::move(e)});
-                }
-                else if(csv_data[0] == "Speak") {
-                    std::shared_ptr<Speak> s = std::make_shared<Speak>(this, path, csv_data);
-                    speak_lines.insert({s->name, std::move(s)});
-                }
-            }
-        }
-
-        ifile.close();
-    }else{
-        qCritical() << "Cannot read pony.ini for pony:"<< path;
-        throw std::exception();
-    }
-
-    if(behaviors.size() == 0) {
-        qCritical() << "Pony:"<<name<<"has no defined behaviors.";
-        throw std::exception();
-    }
-
-    menu = new QMenu(this);
-    QAction *sleep_action = new QAction(trUtf8("Sleeping"),menu);
-    sleep_action->setCheckable(true);
-    connect(sleep_action, SIGNAL(toggled(bool)), this, SLOT(toggle_sleep(bool)));
-
-    menu->addAction(name)->setEnabled(false);
-    menu->addSeparator();
-    menu->addAction(sleep_action);
-    menu->addAction(trUtf8("Remove %1").arg(name), config, SLOT(remove_pony()));
-    menu->addAction(trUtf8("Remove every %1").arg(name), config, SLOT(remove_pony_all()));
-
-    // Select behaviour that will can be choosen randomly
-    for(auto &i: behaviors) {
-        if(i.second.skip_normally == false) {
-            random_behaviors.push_back(&i.second);
-        }
-    }
-
-    if(random_behaviors.size() == 0) {
-        qCritical() << "Pony:"<<name<<"has no defined behaviors that can be randomly selected.";
-        throw std::exception();
-    }
-
+    // Parse pony.ini only once for all instances of this pony
+    pony_template = PonyTemplate::get(path);
 
-    std::sort(random_behaviors.begin(), random_behaviors.end(), [](const Behavior *val1, const Behavior *val2){ return val1->probability < val2->probability;} );
-    total_behavior_probability = 0;
-    for(auto &i: random_behaviors) {
-        total_behavior_probability += i->probability;
-    }
-
-    // Select speech line that will be choosen randomly
-    for(auto &i: speak_lines) {
-        if(i.second->skip_normally == false) {
-            random_speak_lines.push_back(i.second.get());
-        }
-    }
-
-    // Select behaviors that will be used for sleeping
-    for(auto &i: behaviors) {
-        if(i.second.movement_allowed == Behavior::Movement::Sleep) {
-           sleep_behaviors.push_back(&i.second);
-        }
-    }
-
-    // Select behaviors that will be used for dragging
-    for(auto &i: behaviors) {
-        if(i.second.movement_allowed == Behavior::Movement::Dragged) {
-           drag_behaviors.push_back(&i.second);
-        }
-    }
+    name = pony_template->name;
 
-    // Select behaviors that will be used for mouseover
-    for(auto &i: behaviors) {
-        if(i.second.movement_allowed == Behavior::Movement::MouseOver) {
-           mouseover_behaviors.push_back(&i.second);
+    // Initially place the pony randomly on the screen, keeping a 50 pixel border
+    const ScreenLayout &screens = simulation->screens();
+    screen = screens.screen_at(QPoint(0, 0));
+    const QRect &geometry = screens.available_geometry(screen);
+    const float x = 50 + gen()%(geometry.width()-100);
+    const float y = 50 + gen()%(geometry.height()-100);
+    movement_slot = kernel->add(this, x, y);
+
+    behavior_timer.set_callback([this]{ behavior_timeout(); });
+    speech_timer.set_callback([this]{
+        speaking = false;
+        if(pony_view != nullptr) {
+            pony_view->speech_changed();
         }
-    }
+    });
 
-    current_behavior = nullptr;
     change_behavior();
-    this->show();
-
 }
 
 Pony::~Pony()
 {
+    // The view may still look at our state while it is destroyed
+    pony_view.reset();
+
+    simulation->set_ticking(this, false);
+    kernel->remove(movement_slot);
 }
 
-void Pony::set_bypass_wm(bool bypass)
+void Pony::set_view(PonyView *new_view)
 {
-    Qt::WindowFlags windowflags = windowFlags();
-
-    if(bypass == true) {
-        windowflags |= Qt::X11BypassWindowManagerHint;
-    }else{
-        windowflags ^= Qt::X11BypassWindowManagerHint;
-    }
-
-    setWindowFlags( windowflags );
-    text_label.setWindowFlags(windowflags);
+    pony_view.reset(new_view);
+    if(pony_view == nullptr) return;
 
-    // Set window properties for all effect instance windows
-    for(auto &i: effects){
-        for(auto &j: i.second.instances){
-            j->setWindowFlags(windowflags);
+    pony_view->animation_changed();
+    for(auto &i: effects) {
+        for(auto &j: i.instances) {
+            pony_view->effect_added(&j);
         }
     }
-
-    set_on_top(always_on_top);
-
+    pony_view->position_changed();
+    pony_view->speech_changed();
 }
 
-void Pony::set_on_top(bool top)
+PonyView* Pony::view() const
 {
-    always_on_top = top;
-    Qt::WindowFlags windowflags = windowFlags();
-    if(top == true){
-        windowflags |= Qt::WindowStaysOnTopHint; // Enable always on top
-    }else{
-        windowflags ^= Qt::WindowStaysOnTopHint; // Disable always on top
-    }
-
-    setWindowFlags(windowflags);
-    text_label.setWindowFlags(windowflags);
-
-#ifdef Q_WS_X11
-        Atom window_state = XInternAtom( QX11Info::display(), "_NET_WM_STATE", False );
-        Atom window_props[] = {
-            XInternAtom( QX11Info::display(), "_NET_WM_STATE_SKIP_TASKBAR", False ),
-            XInternAtom( QX11Info::display(), "_NET_WM_STATE_SKIP_PAGER"  , False ),
-            XInternAtom( QX11Info::display(), "_NET_WM_STATE_ABOVE", False )
-        };
-        if(top == true){
-            // Set the state to always on top, skip taskbar and pager
-            XChangeProperty( QX11Info::display(), window()->winId(), window_state, XA_ATOM, 32, PropModeReplace, (unsigned char*)&window_props, 3 );
-            XChangeProperty( QX11Info::display(), text_label.window()->winId(), window_state, XA_ATOM, 32, PropModeReplace, (unsigned char*)&window_props, 3 );
-
-            // Set window properties for all effect instance windows
-            for(auto &i: effects){
-                for(auto &j: i.second.instances){
-                    j->setWindowFlags(windowflags);
-                    XChangeProperty( QX11Info::display(), j->window()->winId(), window_state, XA_ATOM, 32, PropModeReplace, (unsigned char*)&window_props, 3 );
-                    j->show();
-                }
-            }
-
-        }else{
-            // Only set skip pager/taskbar
-            XChangeProperty( QX11Info::display(), window()->winId(), window_state, XA_ATOM, 32, PropModeReplace, (unsigned char*)&window_props, 2 );
-            XChangeProperty( QX11Info::display(), text_label.window()->winId(), window_state, XA_ATOM, 32, PropModeReplace, (unsigned char*)&window_props, 2 );
-
-            // Set window properties for all effect instance windows
-            for(auto &i: effects){
-                for(auto &j: i.second.instances){
-                    j->setWindowFlags(windowflags);
-                    XChangeProperty( QX11Info::display(), j->window()->winId(), window_state, XA_ATOM, 32, PropModeReplace, (unsigned char*)&window_props, 2 );
-                    j->show();
-                }
-            }
-        }
-#endif
-    this->show(); // Refresh the window so the changes apply
-    if(text_label.isVisible()){
-        text_label.show();
-    }
+    return pony_view.get();
 }
 
-
-std::shared_ptr<Pony> Pony::get_shared_ptr()
+QPoint Pony::top_left() const
 {
-    return shared_from_this();
+    return QPoint(x_pos() - x_center, y_pos() - y_center);
 }
 
-void Pony::mouseMoveEvent(QMouseEvent* event)
+const QString& Pony::current_image() const
 {
-    if (dragging) {
-        x_pos = event->globalPos().x();
-        y_pos = event->globalPos().y();
-        QPoint new_pos(event->globalPos().x()-current_behavior->x_center,event->globalPos().y()-current_behavior->y_center);
-        move(new_pos);
-        event->accept();
-    }
+    return animations[animation];
 }
 
-void Pony::mousePressEvent(QMouseEvent* event)
+void Pony::start_drag()
 {
-    if (event->button() == Qt::LeftButton) {
-        dragging = true;
-        change_behavior_to(drag_behaviors);
-        event->accept();
-    }
+    dragging = true;
+    change_behavior_to(pony_template->drag_behaviors);
+    sync_movement();
 }
 
-void Pony::mouseReleaseEvent(QMouseEvent* event)
+void Pony::drag_to(const QPoint &pos)
 {
-    if (event->button() == Qt::LeftButton) {
-        dragging = false;
-        if(mouseover == true){
-            change_behavior_to(mouseover_behaviors);
-        }else if(sleeping == true) {
-            change_behavior_to(sleep_behaviors);
-        }else if(!drag_behaviors.empty()){
-            change_behavior();
-        }
-        event->accept();
-    }
+    set_position(pos.x(), pos.y());
+    moved();
 }
 
-void Pony::enterEvent(QEvent* event)
+void Pony::stop_drag()
 {
-    mouseover = true;
-    change_behavior_to(mouseover_behaviors);
-
-    event->accept();
+    dragging = false;
+    if(mouseover == true){
+        change_behavior_to(pony_template->mouseover_behaviors);
+    }else if(sleeping == true) {
+        change_behavior_to(pony_template->sleep_behaviors);
+    }else if(!pony_template->drag_behaviors.empty()){
+        change_behavior();
+    }
+    sync_movement();
+    check_behavior_timeout();
 }
 
-void Pony::leaveEvent(QEvent* event)
+void Pony::set_mouseover(bool over)
 {
-    mouseover = false;
-    if(sleeping == true) {
-        change_behavior_to(sleep_behaviors);
-    }else if(!mouseover_behaviors.empty()){
+    mouseover = over;
+    if(mouseover == true) {
+        change_behavior_to(pony_template->mouseover_behaviors);
+    }else if(sleeping == true) {
+        change_behavior_to(pony_template->sleep_behaviors);
+    }else if(!pony_template->mouseover_behaviors.empty()){
         change_behavior();
     }
-    event->accept();
+    sync_movement();
+    check_behavior_timeout();
 }
 
 void Pony::toggle_sleep(bool is_asleep)
 {
     sleeping = is_asleep;
     if(sleeping == true) {
-        change_behavior_to(sleep_behaviors);
+        change_behavior_to(pony_template->sleep_behaviors);
     }else{
         change_behavior();
     }
-}
-
-
-void Pony::display_menu(const QPoint &pos)
-{
-    menu->exec(mapToGlobal(pos));
-}
-
-void Pony::update_animation(QMovie* animation)
-{
-    // FIXME: sometimes animation gets stuck
-    // happens on mouse leave
-    // behaviors change?, but animation is stopped, even when bouncing off the edge
-    // it is updating, because it moves
-    // it seems the label does not change to the new animation maybe?
-
-    label.setMovie(animation);
-    resize(animation->currentImage().size());
-    label.resize(animation->currentImage().size());
-    label.repaint();
+    sync_movement();
 }
 
 // Change behavior to the specified one
 void Pony::change_behavior_to(const QString &new_behavior)
 {
-    if(behaviors.find(new_behavior) == behaviors.end()) {
+    auto found = pony_template->behaviors.find(new_behavior);
+    if(found == pony_template->behaviors.end()) {
         qCritical() << "Pony:"<<name<<"behavior:"<< new_behavior << "does not exist.";
         return;
     }
@@ -421,29 +166,30 @@ void Pony::change_behavior_to(const QString &new_behavior)
     old_behavior = current_behavior;
 
     if(current_behavior != nullptr) {
-        current_behavior->deinit();
+        deinit_behavior();
     }
 
-    current_behavior = &behaviors.at(new_behavior);
+    current_behavior = &found->second;
 
     setup_current_behavior();
 }
 
 // Change behavior to one randomly selected from supplied list
 // Used for changing to dragged/mouseover/sleeping
-void Pony::change_behavior_to(const std::vector<Behavior*> &new_behavior)
+void Pony::change_behavior_to(const std::vector<const Behavior*> &new_behavior)
 {
     int size = new_behavior.size();
     if(size > 0){
             in_interaction = false; // We interrupted an interaction if there was one, so stop it
-            interaction_delays[current_interaction] = QDateTime::currentMSecsSinceEpoch() + current_interaction_delay;
+            interaction_delays[current_interaction] = simulation->time() + current_interaction_delay;
 
             std::uniform_int_distribution<> dis(0, new_behavior.size()-1);
-            current_behavior->deinit();
+            deinit_behavior();
             current_behavior = new_behavior.at(dis(gen));
-            current_behavior->init();
+            state = current_behavior->type;
+            init_behavior();
 
-            if(config->getSetting<bool>("general/debug")) {
+            if(RuntimeConfig::settings().debug) {
                     qDebug() << "Pony:"<<name<<"behavior: "<< current_behavior->name;
             }
 
@@ -456,35 +202,21 @@ void Pony::change_behavior()
     old_behavior = current_behavior;
 
     if(current_behavior != nullptr) {
-        current_behavior->deinit();
+        deinit_behavior();
     }
 
     follow_object = "";
 
-    // Check if linked behavior is present
-    if(current_behavior != nullptr && current_behavior->linked_behavior != "") {
-        if( behaviors.find(current_behavior->linked_behavior) == behaviors.end()) {
-            qCritical() << "Pony:"<<name<<"linked behavior:"<< current_behavior->linked_behavior<< "from:"<< current_behavior->name << "not present.";
-            // TODO: current_behavior = nullptr and change_behavior(), so we can do another behavior if this is not found
-        }else{
-            current_behavior = &behaviors.at(current_behavior->linked_behavior);
-        }
+    // Follow the linked behavior if there is one. Missing ones were reported when loading, we choose a random behavior instead.
+    if(current_behavior != nullptr && current_behavior->linked != nullptr) {
+        current_behavior = current_behavior->linked;
     }else{
-        // If linked behavior not present, select random behavior using roulette-wheel selection
+        // If linked behavior not present, select random behavior weighted by probability
 
         in_interaction = false; // We finished the interaction if there was one
-        interaction_delays[current_interaction] = QDateTime::currentMSecsSinceEpoch() + current_interaction_delay;
-
-        float total = 0;
-        std::uniform_real_distribution<> dis(0, total_behavior_probability);
-        float rnd = dis(gen);
-        for(auto &i: random_behaviors){
-            total += i->probability;
-            if(rnd <= total) {
-                current_behavior = i;
-                break;
-            }
-        }
+        interaction_delays[current_interaction] = simulation->time() + current_interaction_delay;
+
+        current_behavior = pony_template->random_behaviors[pony_template->random_behavior_table.sample(gen)];
 
     }
 
@@ -495,28 +227,30 @@ void Pony::change_behavior()
 // Initialize current behavior
 void Pony::setup_current_behavior()
 {
+    state = current_behavior->type;
+
     if(current_behavior->type == Behavior::State::Following || current_behavior->type == Behavior::State::MovingToPoint) {
         if(current_behavior->type == Behavior::State::Following){
             // Find follow_object (which is not empty, because we checked it while initializing)
-            auto found = std::find_if(config->ponies.begin(), config->ponies.end(),
-                                          [this](const std::shared_ptr<Pony> &p) {
-                                              return p->name.toLower() == current_behavior->follow_object.toLower();
-                                          });
-            if(found != config->ponies.end()){
-                follow_object = (*found)->name;
+            Pony *found = simulation->find_pony(current_behavior->follow_object);
+            if(found != nullptr){
+                follow_object = found->name;
                 // Destanation point = follow object position + x/y_coordinate offset
-                current_behavior->state = Behavior::State::Following;
-                current_behavior->destanation_point = QPoint((*found)->x_pos + current_behavior->x_coordinate, (*found)->y_pos + current_behavior->y_coordinate);
+                state = Behavior::State::Following;
+                destanation_point = QPoint(found->x_pos() + current_behavior->x_coordinate, found->y_pos() + current_behavior->y_coordinate);
             }else{
                 // If we did not find the targeted pony in active pony list, then set this behavior to normal for the time being
                 follow_object = "";
-                current_behavior->state = Behavior::State::Normal;
+                state = Behavior::State::Normal;
             }
         }
 
         if(current_behavior->type == Behavior::State::MovingToPoint) {
-            current_behavior->destanation_point = QPoint(((float)current_behavior->x_coordinate / 100.0f) * QApplication::desktop()->availableGeometry(this).width(),
-                                                        ((float)current_behavior->y_coordinate / 100.0f) * QApplication::desktop()->availableGeometry(this).height());
+            const ScreenLayout &screens = simulation->screens();
+            screen = screens.screen_at(QPoint(x_pos(), y_pos()), screen);
+            const QRect &geometry = screens.available_geometry(screen);
+            destanation_point = QPoint(((float)current_behavior->x_coordinate / 100.0f) * geometry.width(),
+                                       ((float)current_behavior->y_coordinate / 100.0f) * geometry.height());
         }
     }
 
@@ -530,17 +264,13 @@ void Pony::setup_current_behavior()
     }
 
 
-    if(config->getSetting<bool>("general/debug")) {
+    if(RuntimeConfig::settings().debug) {
             qDebug() << "Pony:"<<name<<"behavior:"<< current_behavior->name <<"for" << behavior_duration << "msec";
     }
 
-    // Update pony position (so it won't jump when we change desktops or something else unexpected happens)
-    if(old_behavior != nullptr){
-        x_pos = x() + old_behavior->x_center;
-        y_pos = y() + old_behavior->y_center;
-    }
-    behavior_started = QDateTime::currentMSecsSinceEpoch();
-    current_behavior->init();
+    behavior_started = simulation->time();
+    behavior_timer.start(&simulation->timers, behavior_started + behavior_duration);
+    init_behavior();
 
     // Select speech line to display:
     // starting_line for current behavior or random
@@ -548,106 +278,620 @@ void Pony::setup_current_behavior()
     //    instead use the ending_line of the previous behavior if current
     //    behavior does not have a starting line
     // If ending_line is present, use that instead of choosing a new one
-    if(speak_lines.size() > 0 && config->getSetting<bool>("speech/enabled")) {
+    if(pony_template->speak_lines.size() > 0 && RuntimeConfig::settings().speech_enabled) {
         Speak* current_speech_line = nullptr;
 
         if(current_behavior->starting_line != ""){
-            // If we have a starting_line, use that
-
-            if( speak_lines.find(current_behavior->starting_line) == speak_lines.end()) {
-                qWarning() << "Pony:"<<name<<"starting line:"<< current_behavior->starting_line<< "from:"<< current_behavior->name << "not present.";
-            }else{
-                current_speech_line = speak_lines.at(current_behavior->starting_line).get();
-            }            
-        }else if(old_behavior != nullptr && old_behavior->ending_line != "" && old_behavior->linked_behavior != current_behavior->name){
+            // If we have a starting_line, use that (nullptr if it does not exist)
+            current_speech_line = current_behavior->starting_speech;
+        }else if(old_behavior != nullptr && old_behavior->ending_line != "" && old_behavior->linked != current_behavior){
             // If we do not have a starting line, and this is a linked behavior, use old behavior's ending line if present
             // old_behavior == nullptr only if we didn't have any previous behaviors (i.e. at startup)
-
-            if( speak_lines.find(old_behavior->ending_line) == speak_lines.end()) {
-                qWarning() << "Pony:"<<name<<"ending line:"<< old_behavior->ending_line<< "from:"<< old_behavior->name << "not present.";
-            }else{
-                current_speech_line = speak_lines.at(old_behavior->ending_line).get();
-            }
-        }else if(!current_behavior->ending_line.isEmpty() || in_interaction || current_behavior->state == Behavior::State::Following){
+            current_speech_line = old_behavior->ending_speech;
+        }else if(!current_behavior->ending_line.isEmpty() || in_interaction || state == Behavior::State::Following){
             // Don not choose a random line if we have an ending one, or we are in an interaction, or we are following
             return;
-        }else if(old_behavior == nullptr || old_behavior->linked_behavior != current_behavior->name) {
+        }else if(old_behavior == nullptr || old_behavior->linked != current_behavior) {
             // If we do not have a starting line and this is NOT a linked behavior, then choose one randomly
             // old_behavior == nullptr only if we didn't have any previous behaviors (i.e. at startup)
 
             std::uniform_real_distribution<> real_dis(0, 100);
             // Speak only with the specified probability
-            if((random_speak_lines.size()) > 0 && (real_dis(gen) <= config->getSetting<float>("speech/probability"))) {
-                std::uniform_int_distribution<> int_dis(0, random_speak_lines.size()-1);
-                current_speech_line = random_speak_lines[int_dis(gen)];
+            if((pony_template->random_speak_lines.size()) > 0 && (real_dis(gen) <= RuntimeConfig::settings().speech_probability)) {
+                std::uniform_int_distribution<> int_dis(0, pony_template->random_speak_lines.size()-1);
+                current_speech_line = pony_template->random_speak_lines[int_dis(gen)];
             }
         }
 
         if(current_speech_line != nullptr) {
             // Show text only if we found a suitable line
-
-            text_label.setText(current_speech_line->text);
+            speech_line = current_speech_line;
             speech_started = behavior_started;
-            text_label.adjustSize();
-            text_label.move(x_pos-text_label.width()/2, y() - text_label.height());
-
-#ifdef Q_WS_X11
-            // Qt on X11 does not support the skip taskbar/pager window flags, we have to set them ourselves
-            // We let Qt initialize the other window properties, which aren't deleted when we replace them with ours
-            // (they probably are appended on show())
+            speaking = true;
+            speech_timer.start(&simulation->timers, speech_started + RuntimeConfig::settings().speech_duration);
 
-            Atom window_state = XInternAtom( QX11Info::display(), "_NET_WM_STATE", False );
-            Atom window_props[] = {
-               XInternAtom( QX11Info::display(), "_NET_WM_STATE_SKIP_TASKBAR", False ),
-               XInternAtom( QX11Info::display(), "_NET_WM_STATE_SKIP_PAGER"  , False )
-            };
-
-            XChangeProperty( QX11Info::display(), text_label.window()->winId(), window_state, XA_ATOM, 32, PropModeReplace, (unsigned char*)&window_props, 2 );
-#endif
+            if(pony_view != nullptr) {
+                pony_view->speech_changed();
+            }
 
-            text_label.show();
-            if(config->getSetting<bool>("sound/enabled")) {
+            if(RuntimeConfig::settings().sound_enabled) {
                 current_speech_line->play();
             }
         }
     }
 }
 
-void Pony::update() {
-    int64_t time = QDateTime::currentMSecsSinceEpoch();
+void Pony::init_behavior()
+{
+    movement = Behavior::Movement::None;
+    moving = true;
+
+    animations[0] = current_behavior->animation_left;
+    animations[1] = current_behavior->animation_right;
+    left_image_center = current_behavior->left_image_center;
+    right_image_center = current_behavior->right_image_center;
+
+    // If we are following or moving to point, use the images of the moving and stopped behaviors
+    if(state == Behavior::State::Following || state == Behavior::State::MovingToPoint){
+
+        // If we do not have a moving behavior, use standard left/right animations
+        const Behavior *moving_behavior = current_behavior->follow_moving;
+        if(moving_behavior != nullptr){
+            // We are not using the animations declared for this behavior, instead we use the ones specified in follow_moving_behavior
+            animations[0] = moving_behavior->animation_left;
+            animations[1] = moving_behavior->animation_right;
+
+            // Set centers of the moving animations
+            left_image_center = moving_behavior->left_image_center;
+            right_image_center = moving_behavior->right_image_center;
+        }
+    }
+
+    // Stopped animations default to the ones of this behavior
+    animations[2] = current_behavior->animation_left;
+    animations[3] = current_behavior->animation_right;
+
+    if(state == Behavior::State::Following || state == Behavior::State::MovingToPoint){
+        // Get left/right filenames from the stopped behavior if we have one
+        const Behavior *stopped_behavior = current_behavior->follow_stopped;
+        if(stopped_behavior != nullptr){
+            animations[2] = stopped_behavior->animation_left;
+            animations[3] = stopped_behavior->animation_right;
+        }
+    }
+
+    // If we do not have the centers of images from configuration, then set them to width/2, height/2
+    if(left_image_center.x() == 0 && left_image_center.y() == 0) {
+        QSize size = pony_template->image_size(animations[0]);
+        left_image_center = QPoint(size.width()/2, size.height()/2);
+    }
+    if(right_image_center.x() == 0 && right_image_center.y() == 0) {
+        QSize size = pony_template->image_size(animations[1]);
+        right_image_center = QPoint(size.width()/2, size.height()/2);
+    }
+
+    // Randomly select movement type from allowed types for this behavior
+    uint8_t movement_allowed = current_behavior->movement_allowed;
+    if(movement_allowed != Behavior::Movement::None && movement_allowed != Behavior::Movement::MouseOver &&
+       movement_allowed != Behavior::Movement::Sleep && movement_allowed != Behavior::Movement::Dragged){
+        std::vector<Behavior::Movement> modes;
+
+        if(movement_allowed & Behavior::Movement::Horizontal) modes.push_back(Behavior::Movement::Horizontal);
+        if(movement_allowed & Behavior::Movement::Vertical)   modes.push_back(Behavior::Movement::Vertical);
+        if(movement_allowed & Behavior::Movement::Diagonal)   modes.push_back(Behavior::Movement::Diagonal);
+
+        movement = modes[gen()%modes.size()];
+    }
+
+    // Randomly select horizontal and vertical direction
+    direction_h = gen()%2 == 0? Behavior::Direction::Left : Behavior::Direction::Right;
+    direction_v = gen()%2 == 0? Behavior::Direction::Up : Behavior::Direction::Down;
+
+    // Set image center for current direction
+    if(direction_h == Behavior::Direction::Right) {
+        x_center = right_image_center.x();
+        y_center = right_image_center.y();
+    }else{
+        x_center = left_image_center.x();
+        y_center = left_image_center.y();
+    }
+
+    if(movement == Behavior::Movement::Diagonal) {
+        choose_angle();
+    }
+
+    animation = direction_h<0?0:1;
+    QSize size = pony_template->image_size(animations[animation]);
+    width = size.width();
+    height = size.height();
+
+    sync_movement();
+    update_bounds();
+
+    if(pony_view != nullptr) {
+        pony_view->animation_changed();
+    }
+
+    // Move due to change in image center
+    moved();
+
+    // Start all effects for this behavior
+    start_effects();
+}
+
+void Pony::deinit_behavior()
+{
+    // Stop all effects for this behavior
+    stop_effects();
+}
 
-    // Check for speech timeout and move text with pony
-    if(text_label.isVisible() == true) {
-        if(speech_started + config->getSetting<int>("speech/duration") <= time) {
-            text_label.hide();
+void Pony::choose_angle()
+{
+    if(direction_v == Behavior::Direction::Up){
+        std::uniform_real_distribution<> dis(15, 50);
+        angle = dis(gen) * M_PI / 180.0;
+    }
+    if(direction_v == Behavior::Direction::Down){
+        std::uniform_real_distribution<> dis(310, 345);
+        angle = dis(gen) * M_PI / 180.0;
+    }
+    if(direction_h == Behavior::Direction::Left) {
+        angle = M_PI - angle;
+    }
+}
+
+void Pony::change_direction(bool right, bool moving)
+{
+    int new_animation = right;
+    if(state == Behavior::State::Following || state == Behavior::State::MovingToPoint){
+        if(moving){
+            new_animation = right; // animation 0 or 1 - follow moving behavior
         }else{
-            text_label.move(x() + current_behavior->x_center - text_label.width()/2, y() - text_label.height());
+            new_animation = 2 + right; // animation 2 or 3 - follow stopped behavior
         }
     }
 
-    // Check behavior timeout and update if not dragging or asleep
-    if(!dragging && !sleeping && !mouseover) {
-        if(behavior_started+behavior_duration <= time){
+    int new_direction = right==true ? Behavior::Direction::Right : Behavior::Direction::Left;
+
+    // Nothing to do if we are already showing that animation (i.e. we are still stopped at the destanation)
+    if(new_animation == animation && new_direction == direction_h) return;
+
+    animation = new_animation;
+    QSize size = pony_template->image_size(animations[animation]);
+    width = size.width();
+    height = size.height();
+    direction_h = new_direction;
+
+    if(right) {
+        x_center = right_image_center.x();
+        y_center = right_image_center.y();
+    }else{
+        x_center = left_image_center.x();
+        y_center = left_image_center.y();
+    }
+
+    sync_movement();
+    update_bounds();
+
+    if(pony_view != nullptr) {
+        pony_view->animation_changed();
+    }
+
+    // Update the direction of all active effects which follow us
+    for(auto &i: effects){
+        if(i.effect->follow == false) continue;
+
+        for(auto &j: i.instances){
+            place_effect_instance(j, right);
+            if(pony_view != nullptr) {
+                pony_view->effect_changed(&j);
+            }
+        }
+    }
+}
+
+// Update the position of everything attached to the pony and tell the view
+void Pony::moved()
+{
+    QPoint pos = top_left();
+
+    for(auto &i: effects){
+        if(i.effect->follow == false) continue;
+
+        for(auto &j: i.instances){
+            j.position = pos + j.offset;
+        }
+    }
+
+    if(pony_view != nullptr) {
+        pony_view->position_changed();
+    }
+}
+
+// The behavior lasted its full duration
+void Pony::behavior_timeout()
+{
+    // Dragged, sleeping and mouseover behaviors last until they are stopped, see check_behavior_timeout()
+    if(dragging || sleeping || mouseover) return;
+
+    change_behavior();
+}
+
+// Change the behavior if it expired while we were dragged, asleep or under the mouse
+void Pony::check_behavior_timeout()
+{
+    if(!dragging && !sleeping && !mouseover && !behavior_timer.is_active()) {
+        change_behavior();
+    }
+}
+
+void Pony::update()
+{
+    // If we are following anypony, update their position
+    if(follow_object != "" && state == Behavior::State::Following){
+        Pony *found = simulation->find_pony(follow_object);
+        if(found != nullptr){
+            destanation_point = QPoint(found->x_pos() + current_behavior->x_coordinate, found->y_pos() + current_behavior->y_coordinate);
+            kernel->dest_x[movement_slot] = destanation_point.x();
+            kernel->dest_y[movement_slot] = destanation_point.y();
+        }else{
+            // The pony we were following is no longer available
             change_behavior();
         }
+    }
 
-        // If we are following anypony, update their position
-        if(follow_object != "" && current_behavior->state == Behavior::State::Following){
-            auto found = std::find_if(config->ponies.begin(), config->ponies.end(),
-                                          [this](const std::shared_ptr<Pony> &p) {
-                                              return p->name == follow_object;
-                                          });
-            if(found != config->ponies.end()){
-                current_behavior->destanation_point = QPoint((*found)->x_pos + current_behavior->x_coordinate, (*found)->y_pos + current_behavior->y_coordinate);
-            }else{
-                // The pony we were following is no longer available
-                change_behavior();
-            }
+    // We may have moved to another screen since the last tick
+    if(kernel->mode[movement_slot] != MovementKernel::Stopped) {
+        update_bounds();
+    }
+}
+
+void Pony::set_position(float x, float y)
+{
+    kernel->x[movement_slot] = x;
+    kernel->y[movement_slot] = y;
+}
+
+// Copy the movement of the current behavior to the kernel.
+// Called whenever the behavior, the direction or the angle changes.
+void Pony::sync_movement()
+{
+    const int i = movement_slot;
+    const float speed = current_behavior->speed;
+
+    uint8_t mode = MovementKernel::Stopped;
+    if(!dragging && !sleeping && !mouseover && movement != Behavior::Movement::None) {
+        if(state == Behavior::State::Following || state == Behavior::State::MovingToPoint) {
+            mode = MovementKernel::ToPoint;
+        }else{
+            mode = MovementKernel::Linear;
         }
-        current_behavior->update();
     }
 
+    // The velocity of ponies moving to a point is calculated by the kernel on every tick
+    float vel_x = 0;
+    float vel_y = 0;
+    if(mode == MovementKernel::Linear) {
+        if(movement == Behavior::Movement::Horizontal){
+            vel_x = direction_h * speed;
+        }
+        if(movement == Behavior::Movement::Vertical){
+            vel_y = direction_v * speed;
+        }
+        if(movement == Behavior::Movement::Diagonal){
+            vel_x = std::sqrt(speed*speed*2) * std::cos(angle);
+            vel_y = -std::sqrt(speed*speed*2) * std::sin(angle);
+        }
+    }
+
+    kernel->mode[i] = mode;
+    if(mode != MovementKernel::ToPoint) {
+        kernel->vel_x[i] = vel_x;
+        kernel->vel_y[i] = vel_y;
+    }
+    kernel->speed[i] = speed;
+    kernel->dir_x[i] = direction_h;
+    kernel->dir_y[i] = direction_v;
+    kernel->dest_x[i] = destanation_point.x();
+    kernel->dest_y[i] = destanation_point.y();
+    kernel->stopped[i] = !moving;
+
+    // Only ponies that move or follow somepony need to be updated on every tick
+    const bool following = !dragging && !sleeping && !mouseover && state == Behavior::State::Following && follow_object != "";
+    simulation->set_ticking(this, mode != MovementKernel::Stopped || following);
+}
+
+// Range of positions of our center that keep the whole image on the screen we are on
+void Pony::update_bounds()
+{
+    // Under X11 the current desktop is (0,0)x(width,height). The desktop on the left is (-width,0)x(0,0),
+    // the desktop to the right is (width,0)x(width*2,height), etc
+    const ScreenLayout &screens = simulation->screens();
+    screen = screens.screen_at(QPoint(x_pos(), y_pos()), screen);
+    const QRect &geometry = screens.available_geometry(screen);
+
+    kernel->min_x[movement_slot] = geometry.left() + x_center;
+    kernel->max_x[movement_slot] = geometry.right() - width + x_center;
+    kernel->min_y[movement_slot] = geometry.top() + y_center;
+    kernel->max_y[movement_slot] = geometry.bottom() - height + y_center;
+}
+
+// Called by the kernel before moving when we reached a screen edge or the destanation point
+void Pony::movement_events(uint8_t events)
+{
+    if(events & MovementKernel::Arrived) {
+        moving = false;
+        change_direction(direction_h==Behavior::Direction::Right,false);
+
+        // TODO: if the centers for stopped and moving are not the same, then
+        //       maybe we must move the window to the center of follow_stopped_behavior?
+    }
+
+    if(events & MovementKernel::NoTarget) {
+        qWarning() << name << "behavior" << current_behavior->name << "is following, but has no target!";
+    }
+
+    if(events & MovementKernel::Turn) {
+        // Face the direction we are going to
+        float dir_x = destanation_point.x() - x_pos();
+        if(dir_x < 0 && direction_h != Behavior::Direction::Left) {
+            moving = true;
+            change_direction(false, true);
+        }else if(dir_x > 0 && direction_h != Behavior::Direction::Right) {
+            moving = true;
+            change_direction(true, true);
+        }else if(moving == false) {
+            // We were stopped, but are moving now, update the animation
+            moving = true;
+            change_direction(direction_h==Behavior::Direction::Right,true);
+        }
+    }
+
+    // At the screen edge, reverse the direction of movement
+    if(events & MovementKernel::BounceLeft) {
+        change_direction(true);
+        if(movement == Behavior::Movement::Diagonal) choose_angle();
+    }
+    if(events & MovementKernel::BounceRight) {
+        change_direction(false);
+        if(movement == Behavior::Movement::Diagonal) choose_angle();
+    }
+    if(events & MovementKernel::BounceTop) {
+        direction_v = Behavior::Direction::Down;
+        if(movement == Behavior::Movement::Diagonal) choose_angle();
+    }
+    if(events & MovementKernel::BounceBottom) {
+        direction_v = Behavior::Direction::Up;
+        if(movement == Behavior::Movement::Diagonal) choose_angle();
+    }
+
+    sync_movement();
+}
+
+// Start all effects for the current behavior
+void Pony::start_effects()
+{
+    if(!RuntimeConfig::settings().effects_enabled) return;
+
+    for(const Effect *i: current_behavior->effects){
+        effects.emplace_back();
+        RunningEffect &running = effects.back();
+        running.effect = i;
+        running.last_instanced = 0;
+        running.respawn_timer.set_callback([this, &running]{ new_effect_instance(running); });
+        running.expire_timer.set_callback([this, &running]{ expire_effect_instances(running); });
+
+        // Add the first effect instance
+        new_effect_instance(running);
+
+        if(RuntimeConfig::settings().debug) {
+            qDebug() << "Pony:"<<name<<"effect:"<< i->name <<"started.";
+        }
+    }
+}
+
+void Pony::stop_effects()
+{
     for(auto &i: effects){
-        i.second.update();
+        if(pony_view != nullptr) {
+            for(auto &j: i.instances){
+                pony_view->effect_removed(&j);
+            }
+        }
+
+        if(RuntimeConfig::settings().debug) {
+            qDebug() << "Pony:"<<name<<"effect:"<< i.effect->name <<"stoped.";
+        }
     }
+
+    effects.clear();
+}
+
+void Pony::new_effect_instance(RunningEffect &running)
+{
+    running.instances.push_back(EffectInstance());
+    EffectInstance &instance = running.instances.back();
+
+    instance.effect = running.effect;
+    instance.time_started = simulation->time();
+    place_effect_instance(instance, direction_h == Behavior::Direction::Right);
+
+    // Move the newly added effect instance to the appropriate position
+    instance.position = top_left() + instance.offset;
+
+    running.last_instanced = instance.time_started;
+
+    if(pony_view != nullptr) {
+        pony_view->effect_added(&instance);
+    }
+
+    // Spawn the next instance after repeat_delay. repeat_delay = 0 means we spawn only one instance
+    if(running.effect->repeat_delay != 0) {
+        running.respawn_timer.start(&simulation->timers, running.last_instanced + (int64_t)(running.effect->repeat_delay*1000.0) + 1);
+    }
+
+    // Duration = 0 means the effect stays there until its stoped
+    if(running.effect->duration != 0 && !running.expire_timer.is_active()) {
+        running.expire_timer.start(&simulation->timers, instance.time_started + (int64_t)(running.effect->duration*1000) + 1);
+    }
+}
+
+// Delete instances that lasted their full duration
+void Pony::expire_effect_instances(RunningEffect &running)
+{
+    const int64_t duration = (int64_t)(running.effect->duration*1000);
+
+    while(!running.instances.empty() && running.instances.front().time_started + duration < simulation->time()) {
+        if(pony_view != nullptr) {
+            pony_view->effect_removed(&running.instances.front());
+        }
+        running.instances.pop_front();
+    }
+
+    // Wait for the oldest remaining one
+    if(!running.instances.empty()) {
+        running.expire_timer.start(&simulation->timers, running.instances.front().time_started + duration + 1);
+    }
+}
+
+// Select the image and the position relative to the pony of an effect instance
+void Pony::place_effect_instance(EffectInstance &instance, bool right)
+{
+    const Effect *effect = instance.effect;
+
+    instance.right = right;
+    if(right){
+        instance.image = effect->image_right;
+        instance.size = pony_template->image_size(instance.image);
+        instance.offset = effect_location(effect->location_right, effect->center_right, instance.size);
+    }else{
+        instance.image = effect->image_left;
+        instance.size = pony_template->image_size(instance.image);
+        instance.offset = effect_location(effect->location_left, effect->center_left, instance.size);
+    }
+
+    instance.position = top_left() + instance.offset;
+}
+
+QPoint Pony::effect_location(int location, int centering, const QSize &image_size)
+{
+    QPoint l;
+    QPoint c;
+
+    const int image_width = image_size.width();
+    const int image_height = image_size.height();
+
+    if(location == Effect::Position::Any){
+        std::uniform_int_distribution<> int_dis(0, Effect::Position::Last - 2);
+        location = int_dis(gen);
+    }else if(location == Effect::Position::Any_NotCenter){
+        std::uniform_int_distribution<> int_dis(0, Effect::Position::Last - 3);
+        location = int_dis(gen);
+    }
+
+    if(centering == Effect::Position::Any){
+        std::uniform_int_distribution<> int_dis(0, Effect::Position::Last - 2);
+        centering = int_dis(gen);
+    }else if(centering == Effect::Position::Any_NotCenter){
+        std::uniform_int_distribution<> int_dis(0, Effect::Position::Last - 3);
+        centering = int_dis(gen);
+    }
+
+    switch(location){
+        case Effect::Position::Top_Right: {
+            l.setY(0);
+            l.setX(width);
+            break;
+        }
+        case Effect::Position::Top_Left: {
+            l.setY(0);
+            l.setX(0);
+            break;
+        }
+        case Effect::Position::Bottom_Right: {
+            l.setY(height);
+            l.setX(width);
+            break;
+        }
+        case Effect::Position::Bottom_Left: {
+            l.setY(height);
+            l.setX(0);
+            break;
+        }
+        case Effect::Position::Top: {
+            l.setY(0);
+            l.setX(width/2);
+            break;
+        }
+        case Effect::Position::Bottom: {
+            l.setY(height);
+            l.setX(width/2);
+            break;
+        }
+        case Effect::Position::Left: {
+            l.setY(height/2);
+            l.setX(0);
+            break;
+        }
+        case Effect::Position::Right: {
+            l.setY(height/2);
+            l.setX(width);
+            break;
+        }
+        case Effect::Position::Center: {
+            l.setY(height/2);
+            l.setX(width/2);
+            break;
+        }
+    }
+
+    switch(centering){
+        case Effect::Position::Top_Right: {
+            c.setY(0);
+            c.setX(image_width);
+            break;
+        }
+        case Effect::Position::Top_Left: {
+            c.setY(0);
+            c.setX(0);
+            break;
+        }
+        case Effect::Position::Bottom_Right: {
+            c.setY(image_height);
+            c.setX(image_width);
+            break;
+        }
+        case Effect::Position::Bottom_Left: {
+            c.setY(image_height);
+            c.setX(0);
+            break;
+        }
+        case Effect::Position::Top: {
+            c.setY(0);
+            c.setX(image_width/2);
+            break;
+        }
+        case Effect::Position::Bottom: {
+            c.setY(image_height);
+            c.setX(image_width/2);
+            break;
+        }
+        case Effect::Position::Left: {
+            c.setY(image_height/2);
+            c.setX(0);
+            break;
+        }
+        case Effect::Position::Right: {
+            c.setY(image_height/2);
+            c.setX(image_width);
+            break;
+        }
+        case Effect::Position::Center: {
+            c.setY(image_height/2);
+            c.setX(image_width/2);
+            break;
+        }
+    }
+
+    return l - c;
 }
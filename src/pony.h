@@ -19,108 +19,191 @@
 #ifndef PONY_H
 #define PONY_H
 
-#include <QtGui/QMovie>
-#include <QtGui/QLabel>
-#include <QMainWindow>
-#include <QMouseEvent>
-#include <QHash>
+#include <QString>
+#include <QPoint>
 
 #include <string>
 #include <unordered_map>
 #include <random>
 #include <memory>
 #include <vector>
+#include <list>
+#include <deque>
+#include <cstdint>
 
 #include "behavior.h"
 #include "effect.h"
 #include "speak.h"
+#include "movementkernel.h"
+#include "random.h"
+#include "timerwheel.h"
 
-class ConfigWindow;
+class PonyTemplate;
+class Simulation;
 
-namespace std
+// Receives the changes of a Pony that have to be shown on screen.
+// The simulation does not need a view, ponies without one are only simulated.
+class PonyView
 {
-        template <>
-        struct hash<QString>
-        {
-            size_t operator()(const QString& s) const
-            {
-                return qHash(s);
-            }
-        };
-}
+public:
+    virtual ~PonyView() {}
+
+    // Displayed image or its size changed (new behavior, direction or moving/stopped)
+    virtual void animation_changed() = 0;
+    // The pony moved, effects following it moved with it
+    virtual void position_changed() = 0;
+    // The pony started or stopped speaking
+    virtual void speech_changed() = 0;
+
+    virtual void effect_added(const EffectInstance *instance) = 0;
+    virtual void effect_changed(const EffectInstance *instance) = 0;
+    virtual void effect_removed(const EffectInstance *instance) = 0;
+};
 
-class Pony : public QMainWindow, public std::enable_shared_from_this<Pony>
+// An effect started by the current behavior, and the instances it spawned
+class RunningEffect
 {
-    Q_OBJECT
 public:
-    explicit Pony(const QString path, ConfigWindow *config, QWidget *parent = 0);
+    RunningEffect() : effect(nullptr), last_instanced(0) {}
+
+    const Effect *effect;
+    int64_t last_instanced;
+    // Oldest first. Instances all last the same time, so they also expire in this order and
+    // are removed from the front. The view keeps pointers to them, which a deque does not move.
+    std::deque<EffectInstance> instances;
+
+    Timer respawn_timer;
+    Timer expire_timer;
+
+private:
+    RunningEffect(const RunningEffect&) = delete;
+    RunningEffect& operator=(const RunningEffect&) = delete;
+};
+
+// Simulated state of one pony on the desktop.
+// Behavior changes, speech and effects are driven by timers of the Simulation, positions are
+// updated on every tick while the pony moves. Drawing them is left to the PonyView.
+class Pony
+{
+public:
+    Pony(const QString &path, Simulation *simulation);
     ~Pony();
 
+    // Called on every tick while we move or follow somepony, see Simulation::set_ticking()
+    void update();
     void change_behavior();
     void change_behavior_to(const QString &new_behavior);
-    void update_animation(QMovie* movie);
-    void set_on_top(bool top);
-    void set_bypass_wm(bool bypass);
-    std::shared_ptr<Pony> get_shared_ptr();
 
-    float x_pos;
-    float y_pos;
-    Behavior* current_behavior;
-    std::vector<Behavior*> random_behaviors;
-    std::unordered_map<QString, Behavior> behaviors;
+    // Input from the view
+    void start_drag();
+    void drag_to(const QPoint &pos);
+    void stop_drag();
+    void set_mouseover(bool over);
+    void toggle_sleep(bool is_asleep);
+
+    // Takes ownership of the view and sends it the current state
+    void set_view(PonyView *new_view);
+    PonyView* view() const;
+
+    // Top left corner of the displayed image on screen
+    QPoint top_left() const;
+    // Displayed image file, relative to the pony directory
+    const QString& current_image() const;
 
-    std::unordered_map<QString, Effect> effects;
+    // Center of the pony, kept in the movement kernel
+    float x_pos() const { return kernel->x[movement_slot]; }
+    float y_pos() const { return kernel->y[movement_slot]; }
 
-    std::unordered_map<QString, std::shared_ptr<Speak>> speak_lines;
-    std::vector<Speak*> random_speak_lines;
+    const Behavior* current_behavior;
 
-    std::vector<Behavior*> sleep_behaviors;
-    std::vector<Behavior*> drag_behaviors;
+    // State of the current behavior
+    Behavior::State state;
+    QPoint destanation_point;
+    int x_center;
+    int y_center;
+    int width;
+    int height;
+    int direction_h;
+    int direction_v;
+    int screen; // Index in Simulation::screens() of the screen we are on
 
-    std::vector<Behavior*> mouseover_behaviors;
+    std::list<RunningEffect> effects;
+
+    std::shared_ptr<const PonyTemplate> pony_template;
 
     QString name;
     QString directory;
 
     bool sleeping;
+    bool dragging;
+    bool mouseover;
+
+    bool speaking;
+    Speak* speech_line;
+    int64_t speech_started;
 
     bool in_interaction;
     std::unordered_map<QString, int64_t> interaction_delays;
     QString current_interaction;
     int current_interaction_delay;
 
-    std::mt19937 gen;
+    Random gen;
 
-public slots:
-    void update();
-    void display_menu(const QPoint &);    
-    void toggle_sleep(bool is_asleep);
+private:
+    friend class MovementKernel;
+    friend class Simulation;
 
-protected:
-    void mouseMoveEvent(QMouseEvent* event);
-    void mousePressEvent(QMouseEvent* event);
-    void mouseReleaseEvent(QMouseEvent* event);
-    void enterEvent(QEvent* event);
-    void leaveEvent(QEvent* event);
+    Pony(const Pony&) = delete;
+    Pony& operator=(const Pony&) = delete;
 
-private:
-    void change_behavior_to(const std::vector<Behavior*> &new_behavior_list);
+    void change_behavior_to(const std::vector<const Behavior*> &new_behavior_list);
     void setup_current_behavior();
-
-    QLabel label;
-    QLabel text_label;
-    Behavior *old_behavior;
+    void init_behavior();
+    void deinit_behavior();
+    void change_direction(bool right, bool moving = true);
+    void choose_angle();
+    void moved();
+    void behavior_timeout();
+    void check_behavior_timeout();
+
+    // Movement kernel interface
+    void set_position(float x, float y);
+    void sync_movement();
+    void update_bounds();
+    void movement_events(uint8_t events);
+
+    void start_effects();
+    void stop_effects();
+    void new_effect_instance(RunningEffect &running);
+    void expire_effect_instances(RunningEffect &running);
+    void place_effect_instance(EffectInstance &instance, bool right);
+    QPoint effect_location(int location, int centering, const QSize &image_size);
+
+    Simulation *simulation;
+    MovementKernel *kernel;
+    int movement_slot;
+    int tick_slot; // Index in Simulation::ticking, -1 if we are not updated on every tick
+    std::unique_ptr<PonyView> pony_view;
+
+    const Behavior *old_behavior;
     QString follow_object;
     int64_t behavior_started;
     int64_t behavior_duration;
-    int64_t speech_started;
-    float total_behavior_probability;
-    ConfigWindow *config;
-    QMenu* menu;
-    bool dragging;
-    bool mouseover;
-    bool always_on_top;
-
+    Timer behavior_timer;
+    Timer speech_timer;
+
+    int movement;
+    bool moving;
+    float angle;
+
+    QString animations[4]; /* 0 - left  / follow_moving left
+                              1 - right / follow_moving right
+                              2 - follow_stopped left
+                              3 - follow_stopped right
+                           */
+    int animation;
+    QPoint left_image_center;
+    QPoint right_image_center;
 };
 
 inline std::basic_ostream<char>& operator<<(std::basic_ostream<char>& os, const QString& str) {
@@ -0,0 +1,361 @@
+/*
+ * Qt-ponies - ponies on the desktop
+ * Copyright (C) 2012 mysha
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <QDataStream>
+#include <QTextStream>
+#include <QByteArray>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QDir>
+#include <QMutexLocker>
+#include <QDebug>
+
+#include <utility>
+
+#include "interaction.h"
+#include "ponydatabase.h"
+
+static const quint32 database_magic = 0x504f4e59; // "PONY"
+static const quint32 database_version = 1;
+
+static QString directory_key(const QString &pony_directory)
+{
+    return QDir::cleanPath(QFileInfo(pony_directory).absoluteFilePath());
+}
+
+static qint64 modification_time(const QString &path)
+{
+    QFileInfo info(path);
+    return info.exists() ? info.lastModified().toMSecsSinceEpoch() : -1;
+}
+
+static QList<QVariantList> to_lists(const PonyDatabase::Lines &lines)
+{
+    QList<QVariantList> lists;
+    for(auto &i: lines) {
+        QVariantList list;
+        for(auto &j: i) {
+            list.append(j);
+        }
+        lists.append(list);
+    }
+    return lists;
+}
+
+static PonyDatabase::Lines from_lists(const QList<QVariantList> &lists)
+{
+    PonyDatabase::Lines lines;
+    lines.reserve(lists.size());
+    for(auto &i: lists) {
+        lines.push_back(std::vector<QVariant>(i.begin(), i.end()));
+    }
+    return lines;
+}
+
+PonyDatabase::PonyDatabase()
+{
+}
+
+PonyDatabase::Mapping::~Mapping()
+{
+    if(data != nullptr) {
+        file.unmap(const_cast<uchar*>(data));
+    }
+}
+
+PonyDatabase& PonyDatabase::instance()
+{
+    static PonyDatabase database;
+    return database;
+}
+
+bool PonyDatabase::parse_file(const QString &path, Lines &lines, const CSVParser::ParseTypes *types)
+{
+    QFile ifile(path);
+    if(!ifile.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        qCritical() << "Cannot open" << path;
+        qCritical() << ifile.errorString();
+        return false;
+    }
+
+    QString line;
+    QTextStream istr(&ifile);
+
+    while (!istr.atEnd() ) {
+        line = istr.readLine();
+
+        if(line[0] != '\'' && !line.isEmpty()) {
+            std::vector<QVariant> csv_data;
+            if(types != nullptr) {
+                CSVParser::ParseLine(csv_data, line, ',', *types);
+            }else{
+                CSVParser::ParseLine(csv_data, line, ',');
+            }
+            lines.push_back(std::move(csv_data));
+        }
+    }
+
+    ifile.close();
+    return true;
+}
+
+QStringList PonyDatabase::list_ponies(const QString &pony_directory, QStringList *directories)
+{
+    QDir dir(pony_directory);
+    dir.setFilter(QDir::Dirs | QDir::NoDotAndDotDot);
+
+    QStringList ponies;
+    for(auto &i: dir.entryList()) {
+        if(directories != nullptr) {
+            directories->append(i);
+        }
+        if(QFile::exists(QString("%1/%2/pony.ini").arg(pony_directory, i))) {
+            ponies.append(i);
+        }
+    }
+    return ponies;
+}
+
+// Modification times of everything the database was compiled from, relative to the pony directory.
+// Adding or removing a directory changes the time of the pony directory, adding a pony.ini changes the time of its directory.
+PonyDatabase::Stamp PonyDatabase::stamp(const QString &pony_directory, const QStringList &directories, const QStringList &ponies)
+{
+    Stamp s;
+    s.append(qMakePair(QString(""), modification_time(pony_directory)));
+    for(auto &i: directories) {
+        s.append(qMakePair(i, modification_time(QString("%1/%2").arg(pony_directory, i))));
+    }
+    for(auto &i: ponies) {
+        QString file = QString("%1/pony.ini").arg(i);
+        s.append(qMakePair(file, modification_time(QString("%1/%2").arg(pony_directory, file))));
+    }
+    s.append(qMakePair(QString("interactions.ini"), modification_time(QString("%1/interactions.ini").arg(pony_directory))));
+    return s;
+}
+
+bool PonyDatabase::compile(const QString &pony_directory, const QString &file)
+{
+    // Taken before reading the files, so changes made while compiling make the database out of date
+    QStringList directories;
+    QStringList ponies = list_ponies(pony_directory, &directories);
+    Stamp s = stamp(pony_directory, directories, ponies);
+
+    // Every pony is written separately, so it can be read without reading the others
+    QByteArray body;
+    QHash<QString, QPair<qint64, qint64>> pony_index;
+    for(auto &i: ponies) {
+        Lines lines;
+        if(!parse_file(QString("%1/%2/pony.ini").arg(pony_directory, i), lines, nullptr)) continue;
+
+        QByteArray record;
+        QDataStream record_stream(&record, QIODevice::WriteOnly);
+        record_stream.setVersion(QDataStream::Qt_4_7);
+        record_stream << to_lists(lines);
+
+        pony_index.insert(i, qMakePair(static_cast<qint64>(body.size()), static_cast<qint64>(record.size())));
+        body.append(record);
+    }
+
+    Lines interaction_lines;
+    parse_file(QString("%1/interactions.ini").arg(pony_directory), interaction_lines, &Interaction::OptionTypes);
+
+    // Write to a temporary file first, so a running instance never maps a partially written database
+    QString temporary = file + ".tmp";
+    QFile ofile(temporary);
+    if(!ofile.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qCritical() << "Cannot write pony database" << temporary;
+        qCritical() << ofile.errorString();
+        return false;
+    }
+
+    QDataStream out(&ofile);
+    out.setVersion(QDataStream::Qt_4_7);
+    out << database_magic << database_version;
+    out << directory_key(pony_directory) << s;
+    out << ponies << to_lists(interaction_lines) << pony_index;
+    out.writeRawData(body.constData(), body.size());
+    ofile.close();
+
+    if(out.status() != QDataStream::Ok || ofile.error() != QFile::NoError) {
+        qCritical() << "Cannot write pony database" << temporary;
+        QFile::remove(temporary);
+        return false;
+    }
+
+    QFile::remove(file);
+    if(!QFile::rename(temporary, file)) {
+        qCritical() << "Cannot write pony database" << file;
+        QFile::remove(temporary);
+        return false;
+    }
+
+    return true;
+}
+
+bool PonyDatabase::open(const QString &pony_directory, const QString &database_file)
+{
+    close();
+
+    std::shared_ptr<const Mapping> loaded = load(pony_directory, database_file);
+    if(loaded == nullptr) {
+        qDebug() << "Compiling pony database" << database_file;
+        if(!compile(pony_directory, database_file)) {
+            return false;
+        }
+
+        loaded = load(pony_directory, database_file);
+        if(loaded == nullptr) {
+            return false;
+        }
+    }
+
+    QMutexLocker lock(&mutex);
+    current = loaded;
+    return true;
+}
+
+// Ponies being read keep the old mapping until they are done
+void PonyDatabase::close()
+{
+    std::shared_ptr<const Mapping> old;
+
+    QMutexLocker lock(&mutex);
+    old.swap(current);
+    lock.unlock();
+}
+
+bool PonyDatabase::is_open() const
+{
+    QMutexLocker lock(&mutex);
+    return current != nullptr;
+}
+
+std::shared_ptr<const PonyDatabase::Mapping> PonyDatabase::mapping_of(const QString &pony_directory) const
+{
+    QMutexLocker lock(&mutex);
+    std::shared_ptr<const Mapping> mapping = current;
+    lock.unlock();
+
+    if(mapping != nullptr && mapping->directory == directory_key(pony_directory)) {
+        return mapping;
+    }
+    return std::shared_ptr<const Mapping>();
+}
+
+std::shared_ptr<const PonyDatabase::Mapping> PonyDatabase::load(const QString &pony_directory, const QString &database_file)
+{
+    std::shared_ptr<Mapping> mapping = std::make_shared<Mapping>();
+
+    mapping->file.setFileName(database_file);
+    if(!mapping->file.open(QIODevice::ReadOnly)) {
+        return std::shared_ptr<const Mapping>();
+    }
+
+    mapping->data = mapping->file.map(0, mapping->file.size());
+    if(mapping->data == nullptr) {
+        return std::shared_ptr<const Mapping>();
+    }
+
+    // Read straight from the mapped file, without copying it
+    QByteArray bytes = QByteArray::fromRawData(reinterpret_cast<const char*>(mapping->data), mapping->file.size());
+    QDataStream in(bytes);
+    in.setVersion(QDataStream::Qt_4_7);
+
+    quint32 magic;
+    quint32 version;
+    in >> magic >> version;
+    if(in.status() != QDataStream::Ok || magic != database_magic || version != database_version) {
+        return std::shared_ptr<const Mapping>();
+    }
+
+    Stamp s;
+    in >> mapping->directory >> s;
+    if(in.status() != QDataStream::Ok || mapping->directory != directory_key(pony_directory)) {
+        return std::shared_ptr<const Mapping>();
+    }
+
+    // Only look at the files we were compiled from, without listing the directories again
+    for(auto &i: s) {
+        QString path = i.first.isEmpty() ? pony_directory : QString("%1/%2").arg(pony_directory, i.first);
+        if(modification_time(path) != i.second) {
+            return std::shared_ptr<const Mapping>();
+        }
+    }
+
+    QList<QVariantList> interaction_lists;
+    in >> mapping->catalog >> interaction_lists >> mapping->index;
+    if(in.status() != QDataStream::Ok) {
+        return std::shared_ptr<const Mapping>();
+    }
+
+    mapping->body_start = in.device()->pos();
+    mapping->interactions = from_lists(interaction_lists);
+
+    return mapping;
+}
+
+QStringList PonyDatabase::ponies(const QString &pony_directory) const
+{
+    std::shared_ptr<const Mapping> mapping = mapping_of(pony_directory);
+    if(mapping != nullptr) {
+        return mapping->catalog;
+    }
+    return list_ponies(pony_directory, nullptr);
+}
+
+PonyDatabase::Lines PonyDatabase::pony_ini(const QString &pony_directory, const QString &pony) const
+{
+    // Keeps the file mapped while we read it, even if the database is opened again meanwhile
+    std::shared_ptr<const Mapping> mapping = mapping_of(pony_directory);
+    if(mapping != nullptr) {
+        auto found = mapping->index.find(pony);
+        if(found != mapping->index.end()) {
+            // Every call uses its own stream over the mapped file, so ponies can be read from several threads
+            QByteArray bytes = QByteArray::fromRawData(reinterpret_cast<const char*>(mapping->data + mapping->body_start + found->first), found->second);
+            QDataStream in(bytes);
+            in.setVersion(QDataStream::Qt_4_7);
+
+            QList<QVariantList> lists;
+            in >> lists;
+            if(in.status() == QDataStream::Ok) {
+                return from_lists(lists);
+            }
+        }
+    }
+
+    Lines lines;
+    if(!parse_file(QString("%1/%2/pony.ini").arg(pony_directory, pony), lines, nullptr)) {
+        qCritical() << "Cannot read pony.ini for pony:"<< pony;
+        throw std::exception();
+    }
+    return lines;
+}
+
+PonyDatabase::Lines PonyDatabase::interactions_ini(const QString &pony_directory) const
+{
+    std::shared_ptr<const Mapping> mapping = mapping_of(pony_directory);
+    if(mapping != nullptr) {
+        return mapping->interactions;
+    }
+
+    Lines lines;
+    if(!parse_file(QString("%1/interactions.ini").arg(pony_directory), lines, &Interaction::OptionTypes)) {
+        qCritical() << "Cannot read interactions.ini";
+    }
+    return lines;
+}
@@ -0,0 +1,104 @@
+/*
+ * Qt-ponies - ponies on the desktop
+ * Copyright (C) 2012 mysha
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PONYDATABASE_H
+#define PONYDATABASE_H
+
+#include <QString>
+#include <QStringList>
+#include <QVariant>
+#include <QFile>
+#include <QHash>
+#include <QPair>
+#include <QMutex>
+
+#include <vector>
+#include <memory>
+#include <cstdint>
+
+#include "csv_parser.h"
+
+// Compiled form of a pony directory: the list of available ponies and the lines of every
+// pony.ini and of interactions.ini, already split into values. Kept in one binary file that
+// is mapped into memory, so starting up does not parse any text. Each pony is only read
+// from the mapped file when it is loaded.
+//
+// The file records the modification times of the pony directory, every pony directory and
+// pony.ini, and interactions.ini. If any of them changed it is compiled again on open().
+// Without an open database everything is read from the text files, as before.
+// Ponies are read from the thread pool while the GUI thread may open the database again: each
+// lookup holds on to the mapping it started with, which is only unmapped once nopony uses it.
+class PonyDatabase
+{
+public:
+    // Values of every line in a file, skipping empty lines and comments
+    typedef std::vector<std::vector<QVariant>> Lines;
+
+    static PonyDatabase& instance();
+
+    // Use the database in 'file' for 'pony_directory', compiling it first if it is missing or out of date.
+    // Returns false if it could not be compiled, the text files are used then.
+    bool open(const QString &pony_directory, const QString &file);
+    void close();
+    bool is_open() const;
+
+    // Write the database of 'pony_directory' to 'file'
+    static bool compile(const QString &pony_directory, const QString &file);
+
+    // Directories in 'pony_directory' containing a pony.ini
+    QStringList ponies(const QString &pony_directory) const;
+    // Throws std::exception if the pony.ini of 'pony' can not be read
+    Lines pony_ini(const QString &pony_directory, const QString &pony) const;
+    Lines interactions_ini(const QString &pony_directory) const;
+
+private:
+    PonyDatabase();
+    PonyDatabase(const PonyDatabase&) = delete;
+    PonyDatabase& operator=(const PonyDatabase&) = delete;
+
+    typedef QList<QPair<QString, qint64>> Stamp;
+
+    static Stamp stamp(const QString &pony_directory, const QStringList &directories, const QStringList &ponies);
+    static QStringList list_ponies(const QString &pony_directory, QStringList *directories);
+    static bool parse_file(const QString &path, Lines &lines, const CSVParser::ParseTypes *types);
+
+    // One opened database file. Never modified after it is loaded.
+    struct Mapping
+    {
+        Mapping() : data(nullptr), body_start(0) {}
+        ~Mapping();
+
+        QFile file;
+        const uchar *data;
+        qint64 body_start;
+
+        QString directory;
+        QStringList catalog;
+        Lines interactions;
+        QHash<QString, QPair<qint64, qint64>> index; // Pony -> offset, size in the body
+    };
+
+    static std::shared_ptr<const Mapping> load(const QString &pony_directory, const QString &file);
+    // The current mapping if it is the database of 'pony_directory', else nullptr
+    std::shared_ptr<const Mapping> mapping_of(const QString &pony_directory) const;
+
+    mutable QMutex mutex; // Guards 'current', not what it points to
+    std::shared_ptr<const Mapping> current;
+};
+
+#endif // PONYDATABASE_H
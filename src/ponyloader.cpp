@@ -0,0 +1,134 @@
+/*
+ * Qt-ponies - ponies on the desktop
+ * Copyright (C) 2012 mysha
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <QCoreApplication>
+#include <QThread>
+#include <QtConcurrentRun>
+#include <QDebug>
+
+#include "animation.h"
+#include "runtimeconfig.h"
+#include "ponytemplate.h"
+#include "simulation.h"
+#include "ponyloader.h"
+#include "pony.h"
+
+// Runs on the thread pool
+static std::shared_ptr<const PonyTemplate> load_template(const QString &path)
+{
+    try {
+        std::shared_ptr<const PonyTemplate> pony_template = PonyTemplate::get(path);
+
+        // Speech lines are QObjects used by the GUI thread, they must not belong to this one
+        for(auto &i: pony_template->speak_lines) {
+            if(i.second->thread() == QThread::currentThread()) {
+                i.second->moveToThread(QCoreApplication::instance()->thread());
+            }
+        }
+
+        return pony_template;
+    }catch (std::exception &e) {
+        return std::shared_ptr<const PonyTemplate>();
+    }
+}
+
+// Runs on the thread pool
+static std::shared_ptr<const AnimationFrames> decode_animation(const QString &path)
+{
+    return AnimationCache::instance().get(path);
+}
+
+PonyLoader::PonyLoader(Simulation *simulation, QObject *parent)
+    : QObject(parent), simulation(simulation)
+{
+}
+
+PonyLoader::~PonyLoader()
+{
+}
+
+void PonyLoader::load(const QString &path)
+{
+    QFutureWatcher<std::shared_ptr<const PonyTemplate>> *watcher = new QFutureWatcher<std::shared_ptr<const PonyTemplate>>(this);
+    template_requests.insert(watcher, path);
+
+    connect(watcher, SIGNAL(finished()), this, SLOT(template_loaded()));
+    watcher->setFuture(QtConcurrent::run(load_template, path));
+}
+
+bool PonyLoader::is_loading() const
+{
+    return !template_requests.isEmpty() || !animation_requests.isEmpty();
+}
+
+void PonyLoader::template_loaded()
+{
+    QFutureWatcher<std::shared_ptr<const PonyTemplate>> *watcher = static_cast<QFutureWatcher<std::shared_ptr<const PonyTemplate>>*>(sender());
+    QString path = template_requests.take(watcher);
+
+    // Keeps the template alive until the pony has it
+    std::shared_ptr<const PonyTemplate> pony_template = watcher->result();
+
+    std::shared_ptr<Pony> pony;
+    if(pony_template) {
+        try {
+            pony = simulation->add_pony(path);
+        }catch (std::exception &e) {
+        }
+    }
+
+    if(!pony) {
+        qCritical() << "Could not load pony" << path;
+        request_done(watcher);
+        return;
+    }
+
+    // The pony is already simulated, it gets its window once the image it starts with is decoded
+    QFutureWatcher<std::shared_ptr<const AnimationFrames>> *animation_watcher = new QFutureWatcher<std::shared_ptr<const AnimationFrames>>(this);
+    animation_requests.insert(animation_watcher, pony);
+
+    connect(animation_watcher, SIGNAL(finished()), this, SLOT(animation_decoded()));
+    animation_watcher->setFuture(QtConcurrent::run(decode_animation, QString("%1/%2/%3").arg(RuntimeConfig::settings().pony_directory, pony->directory, pony->current_image())));
+
+    request_done(watcher);
+}
+
+void PonyLoader::animation_decoded()
+{
+    QFutureWatcher<std::shared_ptr<const AnimationFrames>> *watcher = static_cast<QFutureWatcher<std::shared_ptr<const AnimationFrames>>*>(sender());
+    std::shared_ptr<Pony> pony = animation_requests.take(watcher).lock();
+
+    // Keeps the frames in the cache until the window uses them
+    std::shared_ptr<const AnimationFrames> frames = watcher->result();
+
+    // The pony may have been removed while we were decoding
+    if(pony) {
+        emit loaded(pony.get());
+    }
+
+    request_done(watcher);
+}
+
+void PonyLoader::request_done(QObject *watcher)
+{
+    watcher->deleteLater();
+
+    if(!is_loading()) {
+        emit finished();
+    }
+}
@@ -0,0 +1,67 @@
+/*
+ * Qt-ponies - ponies on the desktop
+ * Copyright (C) 2012 mysha
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PONYLOADER_H
+#define PONYLOADER_H
+
+#include <QObject>
+#include <QString>
+#include <QHash>
+#include <QFutureWatcher>
+
+#include <memory>
+
+class Pony;
+class PonyTemplate;
+class AnimationFrames;
+class Simulation;
+
+// Loads ponies without blocking the GUI thread.
+// Parsing and validating the pony data and decoding the first animation of every pony run
+// on the global thread pool. Only adding the pony to the simulation and creating its window
+// happen on the GUI thread, so ponies appear one by one as they become ready.
+class PonyLoader : public QObject
+{
+    Q_OBJECT
+public:
+    explicit PonyLoader(Simulation *simulation, QObject *parent = 0);
+    ~PonyLoader();
+
+    void load(const QString &path);
+    bool is_loading() const;
+
+signals:
+    // The pony is in the simulation and its first animation is decoded, it needs a view
+    void loaded(Pony *pony);
+    // Every requested pony is loaded or failed to load
+    void finished();
+
+private slots:
+    void template_loaded();
+    void animation_decoded();
+
+private:
+    void request_done(QObject *watcher);
+
+    Simulation *simulation;
+
+    QHash<QObject*, QString> template_requests;
+    QHash<QObject*, std::weak_ptr<Pony>> animation_requests;
+};
+
+#endif // PONYLOADER_H
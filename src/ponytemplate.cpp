@@ -0,0 +1,255 @@
+/*
+ * Qt-ponies - ponies on the desktop
+ * Copyright (C) 2012 mysha
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <QHash>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QImageReader>
+#include <QDebug>
+
+#include <algorithm>
+
+#include "runtimeconfig.h"
+#include "animation.h"
+#include "ponydatabase.h"
+#include "ponytemplate.h"
+
+// Number of random behaviors prefetched while no linked behavior comes next
+static const size_t likely_behavior_count = 3;
+
+PonyTemplate::PonyTemplate(const QString &path)
+    : name(path), directory(path)
+{
+    // Read from the compiled pony database if we have one, else parse pony.ini.
+    // We run on the thread pool, so do not hold on to the settings snapshot while reading.
+    const QString pony_directory = RuntimeConfig::settings().pony_directory;
+    PonyDatabase::Lines lines = PonyDatabase::instance().pony_ini(pony_directory, path);
+
+    for(auto &csv_data: lines) {
+        // TODO: maybe add a try/catch here, in case of malformed pony.ini lines
+        if(csv_data[0] == "Name") {
+            name = csv_data[1].toString(); //Name,"name"
+        }
+        else if(csv_data[0] == "Behavior") {
+            Behavior b(path, csv_data);
+            behaviors.insert({b.name, std::move(b)});
+        }
+        else if(csv_data[0] == "Effect") {
+            Effect e(path, csv_data);
+            effects.insert({e.name, std::move(e)});
+        }
+        else if(csv_data[0] == "Speak") {
+            std::shared_ptr<Speak> s = std::make_shared<Speak>(path, csv_data);
+            speak_lines.insert({s->name, std::move(s)});
+        }
+    }
+
+    if(behaviors.size() == 0) {
+        qCritical() << "Pony:"<<name<<"has no defined behaviors.";
+        throw std::exception();
+    }
+
+    link();
+
+    // Read the image headers now, on the loader thread, so the GUI thread never touches the disk.
+    // Most right images are the left ones flipped, those are drawn from the frames of the left one.
+    for(auto &i: behaviors) {
+        if(i.second.animation_left != "") image_size(i.second.animation_left);
+        if(i.second.animation_right != "") image_size(i.second.animation_right);
+        add_mirror_pair(i.second.animation_left, i.second.animation_right);
+    }
+    for(auto &i: effects) {
+        if(i.second.image_left != "") image_size(i.second.image_left);
+        if(i.second.image_right != "") image_size(i.second.image_right);
+        add_mirror_pair(i.second.image_left, i.second.image_right);
+    }
+
+    // Select behaviour that will can be choosen randomly
+    for(auto &i: behaviors) {
+        if(i.second.skip_normally == false) {
+            random_behaviors.push_back(&i.second);
+        }
+    }
+
+    if(random_behaviors.size() == 0) {
+        qCritical() << "Pony:"<<name<<"has no defined behaviors that can be randomly selected.";
+        throw std::exception();
+    }
+
+    std::vector<float> probabilities;
+    for(auto &i: random_behaviors) {
+        probabilities.push_back(i->probability);
+    }
+    random_behavior_table.build(probabilities);
+
+    likely_behaviors = random_behaviors;
+    std::sort(likely_behaviors.begin(), likely_behaviors.end(), [](const Behavior *a, const Behavior *b){
+        return a->probability > b->probability;
+    });
+    if(likely_behaviors.size() > likely_behavior_count) {
+        likely_behaviors.resize(likely_behavior_count);
+    }
+
+    // Select behaviors that will be used for sleeping, dragging and mouseover
+    for(auto &i: behaviors) {
+        if(i.second.movement_allowed == Behavior::Movement::Sleep) {
+           sleep_behaviors.push_back(&i.second);
+        }
+        if(i.second.movement_allowed == Behavior::Movement::Dragged) {
+           drag_behaviors.push_back(&i.second);
+        }
+        if(i.second.movement_allowed == Behavior::Movement::MouseOver) {
+           mouseover_behaviors.push_back(&i.second);
+        }
+    }
+
+    // Select speech line that will be choosen randomly
+    for(auto &i: speak_lines) {
+        if(i.second->skip_normally == false) {
+            random_speak_lines.push_back(i.second.get());
+        }
+    }
+}
+
+PonyTemplate::~PonyTemplate()
+{
+}
+
+// Resolve the names behaviors use to refer to other behaviors, effects and speech lines,
+// so changing behavior does not look them up. Broken references are reported once, here.
+void PonyTemplate::link()
+{
+    auto find_behavior = [this](const QString &behavior_name) -> const Behavior* {
+        auto found = behaviors.find(behavior_name);
+        return found != behaviors.end() ? &found->second : nullptr;
+    };
+
+    auto find_speech = [this](const QString &line_name) -> Speak* {
+        auto found = speak_lines.find(line_name);
+        return found != speak_lines.end() ? found->second.get() : nullptr;
+    };
+
+    for(auto &i: behaviors) {
+        Behavior &b = i.second;
+
+        if(b.linked_behavior != "") {
+            b.linked = find_behavior(b.linked_behavior);
+            if(b.linked == nullptr) {
+                qCritical() << "Pony:"<<name<<"linked behavior:"<< b.linked_behavior<< "from:"<< b.name << "not present.";
+            }
+        }
+
+        // The images of the moving and stopped behaviors are used when following or moving to a point
+        if(b.type != Behavior::State::Normal && b.follow_moving_behavior != "") {
+            b.follow_moving = find_behavior(b.follow_moving_behavior);
+            if(b.follow_moving == nullptr) {
+                qCritical() << "Pony:"<<name<<"follow moving behavior:"<< b.follow_moving_behavior << "from:"<< b.name << "not present.";
+            }else if(b.follow_moving->animation_left == "") {
+                qCritical() << "Pony:"<<name<<"follow moving behavior:"<< b.follow_moving_behavior << "animation left from:"<< b.name << "not present.";
+                b.follow_moving = nullptr;
+            }
+        }
+
+        if(b.type != Behavior::State::Normal && b.follow_stopped_behavior != "") {
+            b.follow_stopped = find_behavior(b.follow_stopped_behavior);
+            if(b.follow_stopped == nullptr) {
+                qCritical() << "Pony:"<<name<<"follow stopped behavior:"<< b.follow_stopped_behavior << "from:"<< b.name << "not present.";
+            }else if(b.follow_stopped->animation_left == "") {
+                qCritical() << "Pony:"<<name<<"follow stopped behavior:"<< b.follow_stopped_behavior << "animation left from:"<< b.name << "not present.";
+                b.follow_stopped = nullptr;
+            }
+        }
+
+        if(b.starting_line != "") {
+            b.starting_speech = find_speech(b.starting_line);
+            if(b.starting_speech == nullptr) {
+                qWarning() << "Pony:"<<name<<"starting line:"<< b.starting_line<< "from:"<< b.name << "not present.";
+            }
+        }
+
+        if(b.ending_line != "") {
+            b.ending_speech = find_speech(b.ending_line);
+            if(b.ending_speech == nullptr) {
+                qWarning() << "Pony:"<<name<<"ending line:"<< b.ending_line<< "from:"<< b.name << "not present.";
+            }
+        }
+    }
+
+    for(auto &i: effects) {
+        auto found = behaviors.find(i.second.behavior);
+        if(found == behaviors.end()) {
+            qWarning() << "Pony:"<<name<<"effect:"<< i.second.name << "behavior:"<< i.second.behavior << "not present.";
+            continue;
+        }
+        found->second.effects.push_back(&i.second);
+    }
+}
+
+void PonyTemplate::add_mirror_pair(const QString &left, const QString &right) const
+{
+    if(left == "" || right == "" || left == right) return;
+
+    const QString &pony_directory = RuntimeConfig::settings().pony_directory;
+    AnimationCache::instance().add_mirror_pair(QString("%1/%2/%3").arg(pony_directory, directory, left),
+                                               QString("%1/%2/%3").arg(pony_directory, directory, right));
+}
+
+QSize PonyTemplate::image_size(const QString &file) const
+{
+    auto found = image_sizes.find(file);
+    if(found != image_sizes.end()) {
+        return found.value();
+    }
+
+    QImageReader reader(QString("%1/%2/%3").arg(RuntimeConfig::settings().pony_directory, directory, file));
+    QSize size = reader.size();
+    if(!size.isValid()) {
+        qCritical() << "Pony:"<< directory <<"Error reading image:"<< file << reader.errorString();
+        size = QSize(0, 0);
+    }
+
+    image_sizes.insert(file, size);
+    return size;
+}
+
+std::shared_ptr<const PonyTemplate> PonyTemplate::get(const QString &path)
+{
+    // Templates are only kept alive by the ponies using them
+    static QHash<QString, std::weak_ptr<const PonyTemplate>> templates;
+    static QMutex mutex;
+
+    QString key = QString("%1/%2").arg(RuntimeConfig::settings().pony_directory, path);
+
+    {
+        QMutexLocker lock(&mutex);
+        std::shared_ptr<const PonyTemplate> found = templates.value(key).lock();
+        if(found) return found;
+    }
+
+    // Ponies are loaded on several threads, parse without holding the lock
+    std::shared_ptr<const PonyTemplate> loaded = std::make_shared<PonyTemplate>(path);
+
+    QMutexLocker lock(&mutex);
+
+    // Somepony else may have loaded it in the meantime, everypony has to share the same one
+    std::shared_ptr<const PonyTemplate> found = templates.value(key).lock();
+    if(found) return found;
+
+    templates.insert(key, loaded);
+    return loaded;
+}
@@ -0,0 +1,80 @@
+/*
+ * Qt-ponies - ponies on the desktop
+ * Copyright (C) 2012 mysha
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PONYTEMPLATE_H
+#define PONYTEMPLATE_H
+
+#include <QString>
+#include <QSize>
+#include <QHash>
+
+#include <unordered_map>
+#include <vector>
+#include <memory>
+
+#include "behavior.h"
+#include "effect.h"
+#include "speak.h"
+#include "aliastable.h"
+
+// Parsed contents of a pony.ini, shared by every instance of that pony.
+// Nothing is modified after loading, the state of each pony is kept by the Pony.
+class PonyTemplate
+{
+public:
+    explicit PonyTemplate(const QString &path);
+    ~PonyTemplate();
+
+    // Returns the template for the pony in directory 'path', parsing its pony.ini only
+    // if no other pony instance currently uses it. Can be called from any thread.
+    static std::shared_ptr<const PonyTemplate> get(const QString &path);
+
+    QString name;
+    QString directory;
+
+    // Size of an image in the pony directory, read from its header without decoding it.
+    // The images of every behavior and effect are read when the template is loaded.
+    QSize image_size(const QString &file) const;
+
+    std::unordered_map<QString, Behavior> behaviors;
+    std::unordered_map<QString, Effect> effects;
+
+    // Behaviors that can be choosen randomly, and the table selecting them by their probability
+    std::vector<const Behavior*> random_behaviors;
+    AliasTable random_behavior_table;
+    // The most probable random behaviors, their animations are decoded ahead of time
+    std::vector<const Behavior*> likely_behaviors;
+
+    std::vector<const Behavior*> sleep_behaviors;
+    std::vector<const Behavior*> drag_behaviors;
+    std::vector<const Behavior*> mouseover_behaviors;
+
+    std::unordered_map<QString, std::shared_ptr<Speak>> speak_lines;
+    std::vector<Speak*> random_speak_lines;
+
+private:
+    PonyTemplate(const PonyTemplate&) = delete;
+    PonyTemplate& operator=(const PonyTemplate&) = delete;
+
+    void link();
+    void add_mirror_pair(const QString &left, const QString &right) const;
+
+    mutable QHash<QString, QSize> image_sizes;
+};
+
+#endif // PONYTEMPLATE_H
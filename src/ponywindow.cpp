@@ -0,0 +1,713 @@
+/*
+ * Qt-ponies - ponies on the desktop
+ * Copyright (C) 2012 mysha
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <QPixmap>
+#include <QPainter>
+#include <QString>
+#include <QMenu>
+#include <QAction>
+#include <QDebug>
+#include <QStringList>
+
+#include <chrono>
+
+#include "configwindow.h"
+#include "runtimeconfig.h"
+#include "overlay.h"
+#include "ponytemplate.h"
+#include "ponywindow.h"
+
+#ifdef Q_WS_X11
+ #include <QX11Info>
+ #include <X11/Xatom.h>
+ #include <X11/Xlib.h> // Xlib #defines None as 0L, which conflicts with Behavior::Movement::None
+                       // This is why we include it after pony.h
+ #include <X11/extensions/Xfixes.h>
+ #include <X11/extensions/shapeconst.h>
+#endif
+
+// TODO: Maybe a configuration option to change window shape?
+// connect to current_animation: update() signal and do:
+// setMask(current_behavior->current_animation->currentPixmap().mask());
+// or maybe there are better ways to do it
+
+// FIXME: when ponies are not on top, they (all at once) flicker to top sometimes (on text show?)
+
+PonyWindow::PonyWindow(Pony *pony, ConfigWindow *config, QWidget *parent) :
+    QMainWindow(parent), pony(pony), label(this), switch_hit(false), config(config), prefetched_for(nullptr)
+{
+    setAttribute(Qt::WA_TranslucentBackground, true);
+    setAttribute(Qt::WA_ShowWithoutActivating);
+
+#ifdef Q_WS_X11
+    // Disables shadows under the pony window.
+    // We do not set this attribute for the label, because it looks better with a shadow.
+    setAttribute(Qt::WA_X11NetWmWindowTypeDock);
+#endif
+
+#if defined QT_MAC_USE_COCOA && QT_VERSION >= 0x040800
+    // Removes shadows that lag behind animation on OS X. QT 4.8+ needed.
+    setAttribute(Qt::WA_MacNoShadow, true);
+#endif
+
+#ifdef QT_MAC_USE_COCOA
+    // On OS X, tool windows are hidden when another program gains focus.
+    Qt::WindowFlags windowflags = Qt::FramelessWindowHint;
+#else
+    Qt::WindowFlags windowflags = Qt::FramelessWindowHint | Qt::Tool;
+#endif
+
+    always_on_top = RuntimeConfig::settings().always_on_top;
+    if(always_on_top) {
+        windowflags |= Qt::WindowStaysOnTopHint;
+    }
+
+#ifdef Q_WS_X11
+    if(RuntimeConfig::settings().bypass_wm) {
+        // Bypass the window manager
+        windowflags |= Qt::X11BypassWindowManagerHint;
+    }
+#endif
+
+    setWindowFlags( windowflags );
+
+#ifdef Q_WS_X11
+    // In overlay mode the pony window is never shown, so we do not create a native window for it
+    if(!OverlayWindow::active()) {
+        // Qt on X11 does not support the skip taskbar/pager window flags, we have to set them ourselves
+        // We let Qt initialize the other window properties, which aren't deleted when we replace them with ours
+        // (they probably are appended on show())
+        Atom window_state = XInternAtom( QX11Info::display(), "_NET_WM_STATE", False );
+        Atom window_props[] = {
+            XInternAtom( QX11Info::display(), "_NET_WM_STATE_SKIP_TASKBAR", False ),
+            XInternAtom( QX11Info::display(), "_NET_WM_STATE_SKIP_PAGER"  , False )
+        };
+
+        XChangeProperty( QX11Info::display(), window()->winId(), window_state, XA_ATOM, 32, PropModeReplace, (unsigned char*)&window_props, 2 );
+    }
+#endif
+
+    setContextMenuPolicy(Qt::CustomContextMenu);
+    connect(this, SIGNAL(customContextMenuRequested(const QPoint &)), this, SLOT(display_menu(const QPoint &)));
+
+    // Setup speech label
+    text_label.hide();
+    text_label.setAttribute(Qt::WA_ShowWithoutActivating);
+    text_label.setWindowFlags(windowflags);
+    text_label.setAlignment(Qt::AlignHCenter);
+    text_label.setSizePolicy(QSizePolicy::Preferred, QSizePolicy::Preferred);
+
+    menu = new QMenu(this);
+    QAction *sleep_action = new QAction(trUtf8("Sleeping"),menu);
+    sleep_action->setCheckable(true);
+    sleep_action->setChecked(pony->sleeping);
+    connect(sleep_action, SIGNAL(toggled(bool)), this, SLOT(toggle_sleep(bool)));
+
+    menu->addAction(pony->name)->setEnabled(false);
+    menu->addSeparator();
+    menu->addAction(sleep_action);
+    menu->addAction(trUtf8("Remove %1").arg(pony->name), config, SLOT(remove_pony()));
+    menu->addAction(trUtf8("Remove every %1").arg(pony->name), config, SLOT(remove_pony_all()));
+
+    if(!OverlayWindow::active()) {
+        this->show();
+    }
+}
+
+PonyWindow::~PonyWindow()
+{
+    for(auto &i: effect_windows) {
+        EffectWindowPool::instance().release(std::move(i.second));
+    }
+}
+
+void PonyWindow::set_bypass_wm(bool bypass)
+{
+    // The overlay windows are updated instead
+    if(OverlayWindow::active()) return;
+
+    Qt::WindowFlags windowflags = windowFlags();
+
+    if(bypass == true) {
+        windowflags |= Qt::X11BypassWindowManagerHint;
+    }else{
+        windowflags ^= Qt::X11BypassWindowManagerHint;
+    }
+
+    setWindowFlags( windowflags );
+    text_label.setWindowFlags(windowflags);
+
+    // Set window properties for all effect instance windows
+    for(auto &i: effect_windows){
+        i.second->setWindowFlags(windowflags);
+    }
+
+    set_on_top(always_on_top);
+
+}
+
+void PonyWindow::set_on_top(bool top)
+{
+    always_on_top = top;
+    if(OverlayWindow::active()) return;
+
+    Qt::WindowFlags windowflags = windowFlags();
+    if(top == true){
+        windowflags |= Qt::WindowStaysOnTopHint; // Enable always on top
+    }else{
+        windowflags ^= Qt::WindowStaysOnTopHint; // Disable always on top
+    }
+
+    setWindowFlags(windowflags);
+    text_label.setWindowFlags(windowflags);
+
+#ifdef Q_WS_X11
+        Atom window_state = XInternAtom( QX11Info::display(), "_NET_WM_STATE", False );
+        Atom window_props[] = {
+            XInternAtom( QX11Info::display(), "_NET_WM_STATE_SKIP_TASKBAR", False ),
+            XInternAtom( QX11Info::display(), "_NET_WM_STATE_SKIP_PAGER"  , False ),
+            XInternAtom( QX11Info::display(), "_NET_WM_STATE_ABOVE", False )
+        };
+        if(top == true){
+            // Set the state to always on top, skip taskbar and pager
+            XChangeProperty( QX11Info::display(), window()->winId(), window_state, XA_ATOM, 32, PropModeReplace, (unsigned char*)&window_props, 3 );
+            XChangeProperty( QX11Info::display(), text_label.window()->winId(), window_state, XA_ATOM, 32, PropModeReplace, (unsigned char*)&window_props, 3 );
+
+            // Set window properties for all effect instance windows
+            for(auto &i: effect_windows){
+                i.second->setWindowFlags(windowflags);
+                XChangeProperty( QX11Info::display(), i.second->window()->winId(), window_state, XA_ATOM, 32, PropModeReplace, (unsigned char*)&window_props, 3 );
+                i.second->show();
+            }
+
+        }else{
+            // Only set skip pager/taskbar
+            XChangeProperty( QX11Info::display(), window()->winId(), window_state, XA_ATOM, 32, PropModeReplace, (unsigned char*)&window_props, 2 );
+            XChangeProperty( QX11Info::display(), text_label.window()->winId(), window_state, XA_ATOM, 32, PropModeReplace, (unsigned char*)&window_props, 2 );
+
+            // Set window properties for all effect instance windows
+            for(auto &i: effect_windows){
+                i.second->setWindowFlags(windowflags);
+                XChangeProperty( QX11Info::display(), i.second->window()->winId(), window_state, XA_ATOM, 32, PropModeReplace, (unsigned char*)&window_props, 2 );
+                i.second->show();
+            }
+        }
+#endif
+    this->show(); // Refresh the window so the changes apply
+    if(text_label.isVisible()){
+        text_label.show();
+    }
+}
+
+void PonyWindow::mouseMoveEvent(QMouseEvent* event)
+{
+    if (pony->dragging) {
+        pony->drag_to(event->globalPos());
+        config->wake_up(); // Repaint the overlay
+        event->accept();
+    }
+}
+
+void PonyWindow::mousePressEvent(QMouseEvent* event)
+{
+    if (event->button() == Qt::LeftButton) {
+        pony->start_drag();
+        config->wake_up();
+        event->accept();
+    }
+}
+
+void PonyWindow::mouseReleaseEvent(QMouseEvent* event)
+{
+    if (event->button() == Qt::LeftButton) {
+        pony->stop_drag();
+        config->wake_up();
+        event->accept();
+    }
+}
+
+void PonyWindow::enterEvent(QEvent* event)
+{
+    pony->set_mouseover(true);
+    config->wake_up();
+    event->accept();
+}
+
+void PonyWindow::leaveEvent(QEvent* event)
+{
+    pony->set_mouseover(false);
+    config->wake_up();
+    event->accept();
+}
+
+void PonyWindow::toggle_sleep(bool is_asleep)
+{
+    pony->toggle_sleep(is_asleep);
+    config->wake_up();
+}
+
+void PonyWindow::display_menu(const QPoint &pos)
+{
+    menu->exec(mapToGlobal(pos));
+}
+
+void PonyWindow::animation_changed()
+{
+    const QString path = QString("%1/%2/%3").arg(RuntimeConfig::settings().pony_directory, pony->directory, pony->current_image());
+
+    // Frames are shared through the AnimationCache. Images no pony has used recently and the prefetcher
+    // did not decode in time are decoded on the thread pool, we keep showing the old animation meanwhile.
+    switch_hit = AnimationCache::instance().contains(path);
+    switch_started = std::chrono::high_resolution_clock::now();
+    next_animation.reset(new Animation(path));
+
+    if(pony->current_behavior != prefetched_for) {
+        prefetched_for = pony->current_behavior;
+        prefetch_next_behaviors();
+    }
+
+    if(next_animation->is_loaded()) {
+        show_next_animation();
+    }else{
+        connect(next_animation.get(), SIGNAL(loaded()), this, SLOT(show_next_animation()));
+    }
+}
+
+void PonyWindow::show_next_animation()
+{
+    auto end = std::chrono::high_resolution_clock::now();
+    AnimationPrefetcher::instance().record_switch(switch_hit, std::chrono::duration_cast<std::chrono::microseconds>(end - switch_started).count());
+
+    animation = std::move(next_animation);
+
+    if(!animation->is_valid()) {
+        qCritical() << "Pony:"<< pony->directory <<"Error opening animation:"<< pony->current_image() << "for behavior:"<< pony->current_behavior->name;
+    }
+
+    // The window only covers the part of the image that is drawn in any frame
+    const QRect bounds = animation->bounds();
+    resize(bounds.size());
+    move(pony->top_left() + bounds.topLeft());
+    animation->start();
+
+    // In overlay mode the overlay window draws the current frame itself
+    if(OverlayWindow::active()) return;
+
+    connect(animation.get(), SIGNAL(frame_changed(int)), this, SLOT(display_frame()));
+
+    label.setGeometry(QRect(-bounds.topLeft(), animation->current_image().size()));
+    display_frame();
+}
+
+void PonyWindow::position_changed()
+{
+    move(pony->top_left() + (animation != nullptr ? animation->bounds().topLeft() : QPoint()));
+
+    // Move the text with the pony
+    if(pony->speaking) {
+        text_label.move(pony->x_pos() - text_label.width()/2, pony->top_left().y() - text_label.height());
+    }
+
+    // Only effects following the pony move with it
+    for(auto &i: effect_windows) {
+        if(i.first->effect->follow) {
+            i.second->update_position();
+        }
+    }
+}
+
+void PonyWindow::speech_changed()
+{
+    if(!pony->speaking) {
+        text_label.hide();
+        return;
+    }
+
+    text_label.setText(pony->speech_line->text);
+    text_label.adjustSize();
+    text_label.move(pony->x_pos() - text_label.width()/2, pony->top_left().y() - text_label.height());
+
+    if(!OverlayWindow::active()) {
+#ifdef Q_WS_X11
+        // Qt on X11 does not support the skip taskbar/pager window flags, we have to set them ourselves
+        // We let Qt initialize the other window properties, which aren't deleted when we replace them with ours
+        // (they probably are appended on show())
+
+        Atom window_state = XInternAtom( QX11Info::display(), "_NET_WM_STATE", False );
+        Atom window_props[] = {
+           XInternAtom( QX11Info::display(), "_NET_WM_STATE_SKIP_TASKBAR", False ),
+           XInternAtom( QX11Info::display(), "_NET_WM_STATE_SKIP_PAGER"  , False )
+        };
+
+        XChangeProperty( QX11Info::display(), text_label.window()->winId(), window_state, XA_ATOM, 32, PropModeReplace, (unsigned char*)&window_props, 2 );
+#endif
+
+        text_label.show();
+    }
+}
+
+void PonyWindow::effect_added(const EffectInstance *instance)
+{
+    effect_windows[instance] = EffectWindowPool::instance().acquire(instance, pony->directory, this);
+}
+
+void PonyWindow::effect_changed(const EffectInstance *instance)
+{
+    auto found = effect_windows.find(instance);
+    if(found != effect_windows.end()) {
+        found->second->update_animation();
+    }
+}
+
+void PonyWindow::effect_removed(const EffectInstance *instance)
+{
+    auto found = effect_windows.find(instance);
+    if(found != effect_windows.end()) {
+        EffectWindowPool::instance().release(std::move(found->second));
+        effect_windows.erase(found);
+    }
+}
+
+// Decode the animations of the behaviors that probably come next while the current one runs:
+// the linked one, or else the most probable random ones. The current behavior is included,
+// for the other direction and its effects.
+void PonyWindow::prefetch_next_behaviors()
+{
+    prefetch_behavior(pony->current_behavior);
+
+    if(pony->current_behavior->linked != nullptr) {
+        prefetch_behavior(pony->current_behavior->linked);
+        return;
+    }
+
+    for(const Behavior *i: pony->pony_template->likely_behaviors) {
+        prefetch_behavior(i);
+    }
+}
+
+void PonyWindow::prefetch_behavior(const Behavior *behavior)
+{
+    AnimationPrefetcher &prefetcher = AnimationPrefetcher::instance();
+    const QString directory = QString("%1/%2/").arg(RuntimeConfig::settings().pony_directory, pony->directory);
+
+    QStringList images;
+    images << behavior->animation_left << behavior->animation_right;
+    if(behavior->follow_moving != nullptr) {
+        images << behavior->follow_moving->animation_left << behavior->follow_moving->animation_right;
+    }
+    if(behavior->follow_stopped != nullptr) {
+        images << behavior->follow_stopped->animation_left << behavior->follow_stopped->animation_right;
+    }
+    if(RuntimeConfig::settings().effects_enabled) {
+        for(const Effect *i: behavior->effects) {
+            images << i->image_left << i->image_right;
+        }
+    }
+
+    for(const QString &image: images) {
+        if(!image.isEmpty()) {
+            prefetcher.prefetch(directory + image);
+        }
+    }
+}
+
+// Draw the pony, its effects and speech onto an overlay window which has its top left corner at 'origin'
+void PonyWindow::paint(QPainter &painter, const QPoint &origin)
+{
+    for(auto &i: effect_windows) {
+        i.second->paint(painter, origin);
+    }
+
+    if(animation != nullptr) {
+        // Only the part of the frame that is not transparent
+        const QRect bounds = animation->current_bounds();
+        painter.drawImage(pony->top_left() + bounds.topLeft() - origin, animation->current_image(), bounds);
+    }
+
+    if(pony->speaking) {
+        text_label.render(&painter, text_label.pos() - origin);
+    }
+}
+
+// Screen area covered by the pony, its effects and speech
+QRegion PonyWindow::painted_region() const
+{
+    QRegion region(animation != nullptr ? animation->current_bounds().translated(pony->top_left()) : geometry());
+
+    for(auto &i: effect_windows) {
+        region += i.second->painted_rect();
+    }
+
+    if(pony->speaking) {
+        region += text_label.geometry();
+    }
+
+    return region;
+}
+
+void PonyWindow::display_frame()
+{
+    if(animation == nullptr) return;
+
+    label.setPixmap(QPixmap::fromImage(animation->current_image()));
+}
+
+EffectWindow::EffectWindow(QWidget *parent)
+    :QMainWindow(parent), instance(nullptr), label(this)
+{
+    // Set window properties the same as the pony window
+    setAttribute(Qt::WA_TranslucentBackground, true);
+    setAttribute(Qt::WA_ShowWithoutActivating);
+
+#ifdef Q_WS_X11
+    // Disables shadows under the pony window.
+    setAttribute(Qt::WA_X11NetWmWindowTypeDock);
+#endif
+
+#if defined QT_MAC_USE_COCOA && QT_VERSION >= 0x040800
+    // Removes shadows that lag behind animation on OS X. QT 4.8+ needed.
+    setAttribute(Qt::WA_MacNoShadow, true);
+#endif
+
+#ifdef QT_MAC_USE_COCOA
+    // On OS X, tool windows are hidden when another program gains focus.
+    Qt::WindowFlags windowflags = Qt::FramelessWindowHint;
+#else
+    Qt::WindowFlags windowflags = Qt::FramelessWindowHint | Qt::Tool;
+#endif
+
+    if(RuntimeConfig::settings().always_on_top) {
+        windowflags |= Qt::WindowStaysOnTopHint;
+    }
+
+#ifdef Q_WS_X11
+    if(RuntimeConfig::settings().bypass_wm) {
+        // Bypass the window manager
+        windowflags |= Qt::X11BypassWindowManagerHint;
+    }
+#endif
+
+    setWindowFlags( windowflags );
+
+    // In overlay mode the effect window is never shown, so we do not create a native window for it
+    if(!OverlayWindow::active()) {
+#ifdef Q_WS_X11
+        // Qt on X11 does not support the skip taskbar/pager window flags, we have to set them ourselves
+        // We let Qt initialize the other window properties, which aren't deleted when we replace them with ours
+        // (they probably are appended on show())
+        Atom window_state = XInternAtom( QX11Info::display(), "_NET_WM_STATE", False );
+        Atom window_props[] = {
+            XInternAtom( QX11Info::display(), "_NET_WM_STATE_SKIP_TASKBAR", False ),
+            XInternAtom( QX11Info::display(), "_NET_WM_STATE_SKIP_PAGER"  , False )
+        };
+
+        XChangeProperty( QX11Info::display(), window()->winId(), window_state, XA_ATOM, 32, PropModeReplace, (unsigned char*)&window_props, 2 );
+
+        // Set a null input region mask for the event window, so that it does not interfere with mouseover effects.
+        XRectangle rect{0,0,0,0};
+        XserverRegion shapeRegion = XFixesCreateRegion(QX11Info::display(), &rect, 1);
+        XFixesSetWindowShapeRegion(QX11Info::display(), winId(), ShapeInput, 0, 0, shapeRegion);
+        XFixesDestroyRegion(QX11Info::display(), shapeRegion);
+#endif
+        // TODO: add WS_EX_TRANSPARENT extended window style on windows.
+    }
+}
+
+EffectWindow::~EffectWindow()
+{
+}
+
+void EffectWindow::attach(const EffectInstance *new_instance, const QString &new_directory, QWidget *pony_window)
+{
+    instance = new_instance;
+    directory = new_directory;
+
+#ifdef Q_WS_X11
+    // Make sure the effect gets drawn on the same desktop as the pony
+    if(!OverlayWindow::active() && desktop_of != pony_window) {
+        desktop_of = pony_window;
+
+        Atom wm_desktop = XInternAtom(QX11Info::display(), "_NET_WM_DESKTOP", False);
+        Atom type_ret;
+        int fmt_ret;
+        unsigned long nitems_ret;
+        unsigned long bytes_after_ret;
+        int *desktop = NULL;
+
+        if(XGetWindowProperty(QX11Info::display(), pony_window->window()->winId(), wm_desktop, 0, 1,
+                              False, XA_CARDINAL, &type_ret, &fmt_ret,
+                              &nitems_ret, &bytes_after_ret, reinterpret_cast<unsigned char **>(&desktop))
+           == Success && desktop != NULL) {
+           XChangeProperty(QX11Info::display(), window()->winId(), wm_desktop, XA_CARDINAL, 32, PropModeReplace,
+                           reinterpret_cast<unsigned char*>(desktop), 1);
+           XFree(desktop);
+        }
+    }
+#else
+    Q_UNUSED(pony_window);
+#endif
+
+    update_animation();
+
+    if(!OverlayWindow::active()) {
+        show();
+    }
+}
+
+void EffectWindow::detach()
+{
+    hide();
+    animation.reset();
+    label.clear(); // The next effect may take a while to decode, do not show the old one meanwhile
+    image = QString();
+    instance = nullptr;
+}
+
+void EffectWindow::update_animation()
+{
+    if(animation == nullptr || image != instance->image) {
+        // TODO: Do we need to change the direction of active effects? Maybe we only need to display the image for the direction at witch it was spawned.
+        image = instance->image;
+        animation.reset(new Animation(QString("%1/%2/%3").arg(RuntimeConfig::settings().pony_directory, directory, image)));
+        animation->start();
+
+        if(!OverlayWindow::active()) {
+            connect(animation.get(), SIGNAL(frame_changed(int)), this, SLOT(display_frame()));
+        }
+
+        update_position();
+
+        if(animation->is_loaded()) {
+            animation_loaded();
+        }else{
+            // Nothing is drawn until the thread pool decoded the frames
+            connect(animation.get(), SIGNAL(loaded()), this, SLOT(animation_loaded()));
+        }
+        return;
+    }
+
+    update_position();
+}
+
+void EffectWindow::update_position()
+{
+    // The window only covers the part of the image that is drawn in any frame
+    move(instance->position + animation->bounds().topLeft());
+}
+
+void EffectWindow::animation_loaded()
+{
+    if(!animation->is_valid()) {
+        qCritical() << "Effect:"<< directory <<"Error opening animation:"<< image << "for effect:"<< instance->effect->name;
+    }
+
+    fit_animation();
+}
+
+void EffectWindow::fit_animation()
+{
+    const QRect bounds = animation->bounds();
+    resize(bounds.size());
+    update_position();
+
+    // In overlay mode the overlay window draws the current frame itself
+    if(OverlayWindow::active()) return;
+
+    label.setGeometry(QRect(-bounds.topLeft(), animation->current_image().size()));
+    display_frame();
+}
+
+// Draw the effect onto an overlay window which has its top left corner at 'origin'
+void EffectWindow::paint(QPainter &painter, const QPoint &origin)
+{
+    const QRect bounds = animation->current_bounds();
+    painter.drawImage(instance->position + bounds.topLeft() - origin, animation->current_image(), bounds);
+}
+
+QRect EffectWindow::painted_rect() const
+{
+    return animation->current_bounds().translated(instance->position);
+}
+
+void EffectWindow::display_frame()
+{
+    label.setPixmap(QPixmap::fromImage(animation->current_image()));
+}
+
+// Free windows kept by the pool
+static const size_t max_free_effect_windows = 64;
+
+EffectWindowPool::EffectWindowPool()
+    : reuse_count(0), miss_count(0)
+{
+}
+
+EffectWindowPool& EffectWindowPool::instance()
+{
+    static EffectWindowPool pool;
+    return pool;
+}
+
+std::unique_ptr<EffectWindow> EffectWindowPool::acquire(const EffectInstance *instance, const QString &directory, QWidget *pony_window)
+{
+    std::unique_ptr<EffectWindow> window;
+
+    if(!free_windows.empty()) {
+        window = std::move(free_windows.back());
+        free_windows.pop_back();
+        reuse_count++;
+    }else{
+        window.reset(new EffectWindow());
+        miss_count++;
+    }
+
+    window->attach(instance, directory, pony_window);
+    return window;
+}
+
+void EffectWindowPool::release(std::unique_ptr<EffectWindow> window)
+{
+    if(window == nullptr) return;
+
+    if(free_windows.size() >= max_free_effect_windows) {
+        return; // The window is deleted here
+    }
+
+    window->detach();
+    free_windows.push_back(std::move(window));
+}
+
+size_t EffectWindowPool::size() const
+{
+    return free_windows.size();
+}
+
+void EffectWindowPool::clear()
+{
+    free_windows.clear();
+}
+
+uint64_t EffectWindowPool::reused() const
+{
+    return reuse_count;
+}
+
+uint64_t EffectWindowPool::missed() const
+{
+    return miss_count;
+}
@@ -0,0 +1,165 @@
+/*
+ * Qt-ponies - ponies on the desktop
+ * Copyright (C) 2012 mysha
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PONYWINDOW_H
+#define PONYWINDOW_H
+
+#include <QtGui/QLabel>
+#include <QMainWindow>
+#include <QMouseEvent>
+#include <QPainter>
+#include <QRegion>
+#include <QMenu>
+#include <QPointer>
+
+#include <unordered_map>
+#include <memory>
+#include <chrono>
+#include <vector>
+#include <cstdint>
+
+#include "animation.h"
+#include "pony.h"
+
+class ConfigWindow;
+
+// Window showing one instance of an effect. Windows are reused through the EffectWindowPool.
+class EffectWindow : public QMainWindow
+{
+    Q_OBJECT
+public:
+    explicit EffectWindow(QWidget *parent = 0);
+    ~EffectWindow();
+
+    // Show an effect instance of the pony in 'pony_window'
+    void attach(const EffectInstance *instance, const QString &directory, QWidget *pony_window);
+    // Hide the window and stop its animation
+    void detach();
+
+    // Load the image of the instance if it changed and move to its position
+    void update_animation();
+    void update_position();
+    void paint(QPainter &painter, const QPoint &origin);
+    // Screen area of the current frame that is not transparent
+    QRect painted_rect() const;
+
+private slots:
+    void display_frame();
+    void animation_loaded();
+
+private:
+    void fit_animation();
+
+    const EffectInstance *instance;
+    QString directory;
+    QString image;
+    std::unique_ptr<Animation> animation;
+    QLabel label;
+    QPointer<QWidget> desktop_of; // Pony window we took the desktop from
+};
+
+// Hidden effect windows kept for reuse. Setting up a new window takes several round trips to the
+// window server, and effects with a short repeat delay would create one every few ticks.
+// At most 64 free windows are kept, the ones released beyond that are deleted. Windows in use
+// are not limited by the pool, there is one for each running effect instance.
+class EffectWindowPool
+{
+public:
+    static EffectWindowPool& instance();
+
+    // A window showing 'instance', reused if there is a free one
+    std::unique_ptr<EffectWindow> acquire(const EffectInstance *instance, const QString &directory, QWidget *pony_window);
+    // Hide the window and keep it for later, unless the pool is full
+    void release(std::unique_ptr<EffectWindow> window);
+
+    // Number of free windows
+    size_t size() const;
+    // Delete the free windows, i.e. after the window flags changed or before the application exits
+    void clear();
+
+    uint64_t reused() const; // Windows taken from the pool
+    uint64_t missed() const; // Windows created because the pool was empty
+
+private:
+    EffectWindowPool();
+    EffectWindowPool(const EffectWindowPool&) = delete;
+    EffectWindowPool& operator=(const EffectWindowPool&) = delete;
+
+    std::vector<std::unique_ptr<EffectWindow>> free_windows;
+    uint64_t reuse_count;
+    uint64_t miss_count;
+};
+
+// Window showing a Pony with its speech and effects, and passing the mouse input to it
+class PonyWindow : public QMainWindow, public PonyView
+{
+    Q_OBJECT
+public:
+    explicit PonyWindow(Pony *pony, ConfigWindow *config, QWidget *parent = 0);
+    ~PonyWindow();
+
+    void paint(QPainter &painter, const QPoint &origin);
+    QRegion painted_region() const;
+    void set_on_top(bool top);
+    void set_bypass_wm(bool bypass);
+
+    void animation_changed();
+    void position_changed();
+    void speech_changed();
+    void effect_added(const EffectInstance *instance);
+    void effect_changed(const EffectInstance *instance);
+    void effect_removed(const EffectInstance *instance);
+
+    Pony *const pony;
+
+public slots:
+    void display_menu(const QPoint &);
+    void toggle_sleep(bool is_asleep);
+
+private slots:
+    void display_frame();
+    // Replace the animation shown, once the frames of the new one are decoded
+    void show_next_animation();
+
+protected:
+    void mouseMoveEvent(QMouseEvent* event);
+    void mousePressEvent(QMouseEvent* event);
+    void mouseReleaseEvent(QMouseEvent* event);
+    void enterEvent(QEvent* event);
+    void leaveEvent(QEvent* event);
+
+private:
+    void prefetch_next_behaviors();
+    void prefetch_behavior(const Behavior *behavior);
+
+    QLabel label;
+    QLabel text_label;
+    std::unique_ptr<Animation> animation;
+    std::unique_ptr<Animation> next_animation; // Decoded on the thread pool while 'animation' is still shown
+    std::chrono::high_resolution_clock::time_point switch_started;
+    bool switch_hit;
+    std::unordered_map<const EffectInstance*, std::unique_ptr<EffectWindow>> effect_windows;
+    ConfigWindow *config;
+    QMenu* menu;
+    bool always_on_top;
+    const Behavior *prefetched_for; // Behavior we prefetched the next animations for
+
+    friend class OverlayWindow;
+};
+
+#endif // PONYWINDOW_H
@@ -0,0 +1,58 @@
+/*
+ * Qt-ponies - ponies on the desktop
+ * Copyright (C) 2012 mysha
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef RANDOM_H
+#define RANDOM_H
+
+#include <cstdint>
+
+// Small and fast random number generator (PCG32, see pcg-random.org), usable with the <random> distributions.
+// Generators with the same seed and different streams give independent sequences, so every
+// user can have its own generator derived from a single seed (see Simulation::new_random()).
+class Random
+{
+public:
+    typedef uint32_t result_type;
+
+    explicit Random(uint64_t seed = 0x853c49e6748fea9bULL, uint64_t stream = 0xda3e39cb94b95bdbULL)
+        : state(0), increment((stream << 1) | 1)
+    {
+        (*this)();
+        state += seed;
+        (*this)();
+    }
+
+    static constexpr result_type min() { return 0; }
+    static constexpr result_type max() { return 0xffffffff; }
+
+    result_type operator()()
+    {
+        const uint64_t old = state;
+        state = old * 6364136223846793005ULL + increment;
+
+        const uint32_t xorshifted = ((old >> 18) ^ old) >> 27;
+        const uint32_t rot = old >> 59;
+        return (xorshifted >> rot) | (xorshifted << ((-rot) & 31));
+    }
+
+private:
+    uint64_t state;
+    uint64_t increment;
+};
+
+#endif // RANDOM_H
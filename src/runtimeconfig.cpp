@@ -0,0 +1,48 @@
+/*
+ * Qt-ponies - ponies on the desktop
+ * Copyright (C) 2012 mysha
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <utility>
+
+#include "runtimeconfig.h"
+
+std::atomic<const RuntimeSettings*> RuntimeConfig::current(nullptr);
+
+RuntimeConfig::RuntimeConfig()
+{
+}
+
+RuntimeConfig& RuntimeConfig::instance()
+{
+    static RuntimeConfig config;
+    return config;
+}
+
+void RuntimeConfig::publish(const RuntimeSettings &settings)
+{
+    RuntimeSettings *s = new RuntimeSettings(settings);
+
+    const RuntimeSettings *old = current.load(std::memory_order_acquire);
+    s->version = (old != nullptr) ? old->version + 1 : 1;
+
+    current.store(s, std::memory_order_release);
+
+    previous = std::move(latest);
+    latest.reset(s);
+
+    emit changed();
+}
@@ -0,0 +1,83 @@
+/*
+ * Qt-ponies - ponies on the desktop
+ * Copyright (C) 2012 mysha
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef RUNTIMECONFIG_H
+#define RUNTIMECONFIG_H
+
+#include <QObject>
+#include <QString>
+
+#include <atomic>
+#include <memory>
+
+// Copy of the settings used while ponies are running.
+// A snapshot is never modified after it is published, a new one is published instead.
+struct RuntimeSettings
+{
+    unsigned int version;
+
+    QString pony_directory;
+    bool always_on_top;
+    bool bypass_wm;
+    bool interactions_enabled;
+    bool effects_enabled;
+    bool debug;
+    int animation_cache_size; // In MB
+    bool indexed_frames;      // Keep animations as palette indices instead of ARGB
+    int update_rate;          // Updates per second while ponies move
+
+    bool speech_enabled;
+    float speech_probability;
+    int speech_duration;
+
+    bool sound_enabled;
+};
+
+// Publishes RuntimeSettings snapshots, so the code running on every tick does not have
+// to go through QSettings and config_defaults for every option it needs.
+class RuntimeConfig : public QObject
+{
+    Q_OBJECT
+public:
+    static RuntimeConfig& instance();
+
+    // Current settings. publish() must have been called once before.
+    static const RuntimeSettings& settings()
+    {
+        return *current.load(std::memory_order_acquire);
+    }
+
+    // Make a copy of the settings the current ones
+    void publish(const RuntimeSettings &settings);
+
+signals:
+    // Emitted after a new snapshot is published, for users which cache values derived from the settings
+    void changed();
+
+private:
+    RuntimeConfig();
+
+    static std::atomic<const RuntimeSettings*> current;
+
+    // The snapshot before the current one is kept, because a reader may still be using it within
+    // its tick. Anything older is freed, nopony keeps a reference across two publishes.
+    std::unique_ptr<const RuntimeSettings> latest;
+    std::unique_ptr<const RuntimeSettings> previous;
+};
+
+#endif // RUNTIMECONFIG_H
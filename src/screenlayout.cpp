@@ -0,0 +1,74 @@
+/*
+ * Qt-ponies - ponies on the desktop
+ * Copyright (C) 2012 mysha
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "screenlayout.h"
+
+ScreenLayout::ScreenLayout()
+    : screens(1), available(1), primary_screen(0)
+{
+}
+
+ScreenLayout::ScreenLayout(const std::vector<QRect> &geometry, const std::vector<QRect> &available_geometry, int primary)
+    : screens(geometry), available(available_geometry), primary_screen(primary)
+{
+    if(screens.empty()) {
+        screens.push_back(QRect());
+        available.push_back(QRect());
+    }
+    available.resize(screens.size());
+
+    if(primary_screen < 0 || primary_screen >= count()) {
+        primary_screen = 0;
+    }
+}
+
+int ScreenLayout::count() const
+{
+    return screens.size();
+}
+
+int ScreenLayout::primary() const
+{
+    return primary_screen;
+}
+
+int ScreenLayout::screen_at(const QPoint &point, int hint) const
+{
+    if(hint >= 0 && hint < count() && screens[hint].contains(point)) {
+        return hint;
+    }
+
+    for(int i = 0; i < count(); i++) {
+        if(screens[i].contains(point)) {
+            return i;
+        }
+    }
+
+    // Same as QDesktopWidget::availableGeometry() for points outside of every screen
+    return primary_screen;
+}
+
+const QRect& ScreenLayout::geometry(int screen) const
+{
+    return screens[screen];
+}
+
+const QRect& ScreenLayout::available_geometry(int screen) const
+{
+    return available[screen];
+}
@@ -0,0 +1,54 @@
+/*
+ * Qt-ponies - ponies on the desktop
+ * Copyright (C) 2012 mysha
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SCREENLAYOUT_H
+#define SCREENLAYOUT_H
+
+#include <QPoint>
+#include <QRect>
+
+#include <vector>
+
+// Geometry of the screens of the desktop, kept so the ponies do not ask the window system
+// on every tick. The application replaces it when the desktop changes, the benchmark
+// describes a virtual screen with it.
+class ScreenLayout
+{
+public:
+    // A single empty screen
+    ScreenLayout();
+    // 'available' is the part of each screen not covered by panels and taskbars
+    ScreenLayout(const std::vector<QRect> &geometry, const std::vector<QRect> &available, int primary);
+
+    int count() const;
+    int primary() const;
+
+    // Screen containing 'point', or the primary one if no screen contains it.
+    // 'hint' (i.e. the screen a pony was on in the last tick) is checked first.
+    int screen_at(const QPoint &point, int hint = -1) const;
+
+    const QRect& geometry(int screen) const;
+    const QRect& available_geometry(int screen) const;
+
+private:
+    std::vector<QRect> screens;
+    std::vector<QRect> available;
+    int primary_screen;
+};
+
+#endif // SCREENLAYOUT_H
@@ -0,0 +1,270 @@
+/*
+ * Qt-ponies - ponies on the desktop
+ * Copyright (C) 2012 mysha
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <QDebug>
+
+#include <algorithm>
+#include <random>
+
+#include "runtimeconfig.h"
+#include "ponydatabase.h"
+#include "simulation.h"
+#include "pony.h"
+
+// Interactions are checked less often than the ponies move
+static const int64_t interaction_interval = 500;
+
+// Longest movement step in msec, at the lowest update rate. Longer pauses (i.e. the computer
+// was suspended) do not make the ponies jump.
+static const int64_t max_movement_step = 100;
+
+Simulation::Simulation(int64_t start_time, const ScreenLayout &screens, uint64_t seed)
+    : timers(start_time), screen_layout(screens), seed(seed), next_stream(0), gen(new_random()),
+      current_time(start_time), next_interaction_update(start_time + interaction_interval)
+{
+}
+
+Simulation::~Simulation()
+{
+}
+
+void Simulation::update(int64_t time)
+{
+    // Ponies move by the time since the last update. If nopony was moving, those starting now make a single step.
+    float step = 1.0f;
+    if(!ticking.empty()) {
+        step = std::min(time - current_time, max_movement_step) / static_cast<float>(MovementKernel::reference_tick);
+    }
+
+    current_time = time;
+
+    // Behaviors, effects and speech that are due, then the ponies moving or following somepony,
+    // then everypony moves at once
+    timers.advance(time);
+
+    ticking_now = ticking;
+    for(Pony *i: ticking_now) {
+        i->update();
+    }
+    movement_kernel.update(step);
+
+    if(next_interaction_update <= time) {
+        next_interaction_update = time + interaction_interval;
+        update_interactions();
+    }
+}
+
+int64_t Simulation::time() const
+{
+    return current_time;
+}
+
+int64_t Simulation::next_update_time() const
+{
+    if(!ticking.empty()) return current_time;
+
+    int64_t next = timers.next_time();
+
+    if(RuntimeConfig::settings().interactions_enabled && !interactions.empty() && ponies.size() > 1) {
+        next = std::min(next, next_interaction_update);
+    }
+
+    return next;
+}
+
+void Simulation::set_screens(const ScreenLayout &new_screens)
+{
+    screen_layout = new_screens;
+}
+
+const ScreenLayout& Simulation::screens() const
+{
+    return screen_layout;
+}
+
+Random Simulation::new_random()
+{
+    return Random(seed, next_stream++);
+}
+
+std::shared_ptr<Pony> Simulation::add_pony(const QString &path)
+{
+    ponies.emplace_back(std::make_shared<Pony>(path, this));
+    return ponies.back();
+}
+
+void Simulation::remove_pony(const Pony *pony)
+{
+    ponies.remove_if([pony](const std::shared_ptr<Pony> &p){
+        return p.get() == pony;
+    });
+}
+
+void Simulation::set_ticking(Pony *pony, bool tick)
+{
+    if(tick == (pony->tick_slot != -1)) return;
+
+    if(tick) {
+        pony->tick_slot = ticking.size();
+        ticking.push_back(pony);
+    }else{
+        // Move the last pony into the free slot
+        Pony *last = ticking.back();
+        ticking[pony->tick_slot] = last;
+        last->tick_slot = pony->tick_slot;
+        ticking.pop_back();
+        pony->tick_slot = -1;
+    }
+}
+
+int Simulation::ticking_count() const
+{
+    return ticking.size();
+}
+
+Pony* Simulation::find_pony(const QString &name) const
+{
+    for(auto &i: ponies) {
+        if(i->name.compare(name, Qt::CaseInsensitive) == 0) {
+            return i.get();
+        }
+    }
+    return nullptr;
+}
+
+void Simulation::load_interactions(const QString &pony_directory)
+{
+    interactions.clear();
+
+    for(auto &csv_data: PonyDatabase::instance().interactions_ini(pony_directory)) {
+        try {
+            interactions.emplace_back(csv_data);
+        }catch (std::exception &e) {
+            qCritical() << "Could not load interaction.";
+        }
+    }
+
+    // Size the grid cells so most interaction checks only look at the neighbouring cells
+    int max_distance = 0;
+    for(auto &i: interactions) {
+        max_distance = std::max(max_distance, i.distance);
+    }
+    pony_grid.set_cell_size(std::max(max_distance, 50));
+}
+
+// Rebuild the spatial index of pony positions
+void Simulation::update_pony_grid()
+{
+    pony_grid.clear();
+    for(const std::shared_ptr<Pony> &p: ponies) {
+        pony_grid.insert(p->x_pos(), p->y_pos(), p.get());
+    }
+}
+
+void Simulation::update_interactions()
+{
+    if(!RuntimeConfig::settings().interactions_enabled) return;
+
+    update_pony_grid();
+
+    std::uniform_real_distribution<> real_dis(0, 1);
+
+    int64_t time = current_time;
+
+    // For each interaction
+    for(auto &i: interactions){
+        // check probability
+
+        // For each pony that starts this interaction
+        for(auto &p: ponies) {
+            if(p->name.compare(i.pony, Qt::CaseInsensitive) != 0) continue;
+            if(p->in_interaction) continue;
+            if((p->interaction_delays.find(i.name) != p->interaction_delays.end()) && // Check if there is an active delay for this interaction in this pony
+                    (p->interaction_delays.at(i.name) > time)) continue;
+
+            // TODO: add it to interaction instance, and when cancelling, cancel interaction for every pony in interaction
+            std::vector<Pony*> interaction_targets;
+
+            // For each pony close enough to interact
+            pony_grid.query(p->x_pos(), p->y_pos(), i.distance, [&](Pony *pp, float) {
+                if(pp == p.get()) return; // Do not interact with self
+
+                // Check if this pony is one of the targets of the interaction
+                bool is_target = false;
+                for(const QVariant &p_target: i.targets) {
+                    if(pp->name.compare(p_target.toString(), Qt::CaseInsensitive) == 0) {
+                        is_target = true;
+                        break;
+                    }
+                }
+                if(!is_target) return;
+
+                if(pp->in_interaction){
+                    return; // The pony is already in an interaction
+                }else if(pp->sleeping){
+                    return; // Sleeping ponies do not interact
+                }else if((pp->interaction_delays.find(i.name) != pp->interaction_delays.end()) && // Check if there is an active delay for this interaction in this pony
+                                     (pp->interaction_delays.at(i.name) > time)) {
+                    return; // The pony has an active delay for this interaction
+                }else{
+                    // We found a suitable pony, we can do the interaction
+                    if(real_dis(gen) <= i.probability) {
+                        // Only interact with specified probability
+                        interaction_targets.push_back(pp);
+                    }
+                }
+            });
+
+            if(interaction_targets.empty()) {
+                // We didn't find anypony to interact with, check the next initiating pony for this interaction
+                continue;
+            }
+
+            QString selected_behavior = i.select_behavior(gen);
+
+            p->current_interaction = i.name;
+            p->current_interaction_delay = i.reactivation_delay;
+            p->in_interaction = true;
+            p->change_behavior_to(selected_behavior);
+
+            if(i.select_every_taget == false) { // Select random pony to interact with
+                std::uniform_int_distribution<> dis(0, interaction_targets.size()-1);
+                uint32_t rnd = dis(gen);
+
+                interaction_targets[rnd]->current_interaction = i.name;
+                interaction_targets[rnd]->current_interaction_delay = i.reactivation_delay;
+                interaction_targets[rnd]->in_interaction = true;
+                interaction_targets[rnd]->change_behavior_to(selected_behavior);
+                if(RuntimeConfig::settings().debug) {
+                    qDebug() << p->name << "interacting with" << interaction_targets[rnd]->name << "using behavior" << selected_behavior << "for interaction" << i.name;
+                }
+            }else{
+                // Interact with all suitable ponies
+                for(auto &t: interaction_targets) {
+                    t->current_interaction = i.name;
+                    t->current_interaction_delay = i.reactivation_delay;
+                    t->in_interaction = true;
+                    t->change_behavior_to(selected_behavior);
+                    if(RuntimeConfig::settings().debug) {
+                        qDebug() << p->name << " interacting with " << t->name << " using " << selected_behavior << " for interaction " << i.name;
+                    }
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,106 @@
+/*
+ * Qt-ponies - ponies on the desktop
+ * Copyright (C) 2012 mysha
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SIMULATION_H
+#define SIMULATION_H
+
+#include <QString>
+#include <QPoint>
+#include <QRect>
+
+#include <memory>
+#include <list>
+#include <vector>
+#include <cstdint>
+
+#include "interaction.h"
+#include "spatialgrid.h"
+#include "movementkernel.h"
+#include "random.h"
+#include "timerwheel.h"
+#include "screenlayout.h"
+
+class Pony;
+
+// Windowless core that moves the ponies, selects their behaviors, runs their effects
+// and starts interactions between them. It does not need a QApplication or any widgets:
+// the desktop is described by a ScreenLayout and time is passed to update(),
+// so it can also run on a virtual screen (see bench/).
+class Simulation
+{
+public:
+    // Every random choice is derived from 'seed', the same seed and inputs give the same simulation
+    Simulation(int64_t start_time, const ScreenLayout &screens, uint64_t seed);
+    ~Simulation();
+
+    // Advance every pony to 'time' (in msec). Updates can be any time apart, movement is scaled by the time that passed.
+    void update(int64_t time);
+
+    // Time of the last update
+    int64_t time() const;
+    // Time the next update has something to do: time() while ponies are moving, else when
+    // the next timer fires or interactions are checked. The largest int64_t if nothing
+    // happens until a pony receives input.
+    int64_t next_update_time() const;
+
+    // Replace the screens when the desktop changed. Ponies pick up the new bounds on their next move.
+    void set_screens(const ScreenLayout &new_screens);
+    const ScreenLayout& screens() const;
+
+    // Generator with its own stream, for a pony or a subsystem
+    Random new_random();
+
+    // Throws std::exception if the pony could not be loaded
+    std::shared_ptr<Pony> add_pony(const QString &path);
+    void remove_pony(const Pony *pony);
+
+    // First pony with the given name (case insensitive), or nullptr
+    Pony* find_pony(const QString &name) const;
+
+    // Load interactions.ini of the pony directory
+    void load_interactions(const QString &pony_directory);
+    void update_interactions();
+
+    // Add or remove a pony from the ones updated on every tick. Everypony else only
+    // changes when one of its timers fires or it receives input.
+    void set_ticking(Pony *pony, bool ticking);
+    int ticking_count() const;
+
+    // Must outlive the ponies, they remove themselves from them
+    TimerWheel timers;
+    MovementKernel movement_kernel;
+    std::list<std::shared_ptr<Pony>> ponies;
+
+private:
+    void update_pony_grid();
+
+    ScreenLayout screen_layout;
+    uint64_t seed;
+    uint64_t next_stream;
+    Random gen;
+    int64_t current_time;
+    int64_t next_interaction_update;
+
+    std::vector<Pony*> ticking;
+    std::vector<Pony*> ticking_now; // Copy of 'ticking' for the current tick, ponies may stop ticking while we update them
+
+    std::vector<Interaction> interactions;
+    SpatialGrid<Pony*> pony_grid;
+};
+
+#endif // SIMULATION_H
@@ -0,0 +1,108 @@
+/*
+ * Qt-ponies - ponies on the desktop
+ * Copyright (C) 2012 mysha
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SPATIALGRID_H
+#define SPATIALGRID_H
+
+#include <unordered_map>
+#include <vector>
+#include <cstdint>
+#include <cmath>
+
+// Uniform grid of square cells over points on the desktop.
+// Finds all items within a distance of a point by only looking at the cells
+// overlapping that circle, instead of checking every pair of items.
+//
+// Cells are kept when the grid is cleared, so rebuilding it every tick
+// does not allocate once the grid has seen every part of the desktop.
+template <typename T>
+class SpatialGrid
+{
+public:
+    explicit SpatialGrid(float cell_size = 100.0f)
+        : cell_size(cell_size)
+    {
+    }
+
+    void set_cell_size(float size)
+    {
+        cell_size = size;
+        cells.clear();
+    }
+
+    void clear()
+    {
+        for(auto &i: cells) {
+            i.second.clear();
+        }
+    }
+
+    void insert(float x, float y, const T &item)
+    {
+        cells[key(cell(x), cell(y))].push_back({x, y, item});
+    }
+
+    // Calls callback(item, distance) for every item within radius of (x,y)
+    template <typename F>
+    void query(float x, float y, float radius, F callback) const
+    {
+        const int x_min = cell(x - radius);
+        const int x_max = cell(x + radius);
+        const int y_min = cell(y - radius);
+        const int y_max = cell(y + radius);
+        const float radius_sq = radius * radius;
+
+        for(int cx = x_min; cx <= x_max; cx++) {
+            for(int cy = y_min; cy <= y_max; cy++) {
+                auto found = cells.find(key(cx, cy));
+                if(found == cells.end()) continue;
+
+                for(const Entry &e: found->second) {
+                    const float dx = e.x - x;
+                    const float dy = e.y - y;
+                    const float dist_sq = dx*dx + dy*dy;
+                    if(dist_sq <= radius_sq) {
+                        callback(e.item, std::sqrt(dist_sq));
+                    }
+                }
+            }
+        }
+    }
+
+private:
+    struct Entry {
+        float x;
+        float y;
+        T item;
+    };
+
+    int cell(float coordinate) const
+    {
+        return static_cast<int>(std::floor(coordinate / cell_size));
+    }
+
+    static int64_t key(int cx, int cy)
+    {
+        return (static_cast<int64_t>(cx) << 32) ^ static_cast<uint32_t>(cy);
+    }
+
+    float cell_size;
+    std::unordered_map<int64_t, std::vector<Entry>> cells;
+};
+
+#endif // SPATIALGRID_H
@@ -23,9 +23,8 @@
  #include <Phonon/AudioOutput>
 #endif
 
-#include "configwindow.h"
+#include "runtimeconfig.h"
 #include "speak.h"
-#include "pony.h"
 
 // These are the variable types for Behavior configuration
 const CSVParser::ParseTypes Speak::OptionTypes {
@@ -37,8 +36,8 @@ const CSVParser::ParseTypes Speak::OptionTypes {
 };
 
 //TODO: move player to Pony and pass a pointer on play() to it
-Speak::Speak(Pony* parent, const QString filepath, const std::vector<QVariant> &options)
-    :QObject(parent), parent(parent), path(filepath), audioOutput(nullptr), mediaObject(nullptr)
+Speak::Speak(const QString filepath, const std::vector<QVariant> &options)
+    :path(filepath), audioOutput(nullptr), mediaObject(nullptr)
 {
 
     if(options.size() == 2) { // Speak, "text"
@@ -82,7 +81,7 @@ void Speak::play()
         mediaObject = new Phonon::MediaObject(this);
     }
 
-    mediaObject->setCurrentSource(ConfigWindow::getSetting<QString>("general/pony-directory") + "/" + path + "/" + soundfiles[0].toString());
+    mediaObject->setCurrentSource(RuntimeConfig::settings().pony_directory + "/" + path + "/" + soundfiles[0].toString());
     connect(mediaObject, SIGNAL(finished()), this, SLOT(stop()));
 
     Phonon::createPath(mediaObject, audioOutput);
@@ -28,8 +28,6 @@
 
 #include "csv_parser.h"
 
-class Pony;
-
 namespace Phonon {
     class AudioOutput;
     class MediaObject;
@@ -39,7 +37,7 @@ class Speak : public QObject
 {
     Q_OBJECT
 public:
-    Speak(Pony* parent, const QString filepath, const std::vector<QVariant> &options);
+    Speak(const QString filepath, const std::vector<QVariant> &options);
     ~Speak();
 
     void play();
@@ -55,7 +53,6 @@ public slots:
     void stop();
 
 private:
-    Pony* parent;
     QString path;
 
     Phonon::AudioOutput *audioOutput;
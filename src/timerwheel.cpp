@@ -0,0 +1,262 @@
+/*
+ * Qt-ponies - ponies on the desktop
+ * Copyright (C) 2012 mysha
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <limits>
+
+#include "timerwheel.h"
+
+Timer::Timer(const std::function<void()> &callback)
+    : callback(callback), wheel(nullptr), when(0), slot(nullptr), prev(nullptr), next(nullptr)
+{
+}
+
+Timer::~Timer()
+{
+    stop();
+}
+
+void Timer::set_callback(const std::function<void()> &new_callback)
+{
+    callback = new_callback;
+}
+
+void Timer::start(TimerWheel *new_wheel, int64_t time)
+{
+    stop();
+
+    wheel = new_wheel;
+    when = time;
+    wheel->insert(this);
+}
+
+void Timer::stop()
+{
+    if(wheel != nullptr) {
+        wheel->unlink(this);
+        wheel = nullptr;
+    }
+}
+
+bool Timer::is_active() const
+{
+    return wheel != nullptr;
+}
+
+int64_t Timer::time() const
+{
+    return when;
+}
+
+TimerWheel::TimerWheel(int64_t start_time)
+    : current(start_time), count(0)
+{
+    for(int i = 0; i < levels; i++) {
+        occupied[i] = 0;
+        for(int j = 0; j < level_size; j++) {
+            buckets[i][j] = nullptr;
+        }
+    }
+}
+
+TimerWheel::~TimerWheel()
+{
+    // Timers outliving us become inactive
+    for(int i = 0; i < levels; i++) {
+        for(int j = 0; j < level_size; j++) {
+            while(buckets[i][j] != nullptr) {
+                Timer *timer = buckets[i][j];
+                unlink(timer);
+                timer->wheel = nullptr;
+            }
+        }
+    }
+}
+
+int64_t TimerWheel::time() const
+{
+    return current;
+}
+
+int64_t TimerWheel::next_time() const
+{
+    int64_t next = std::numeric_limits<int64_t>::max();
+    if(count == 0) return next;
+
+    // The first occupied slot after the current one holds the earliest timers of its level,
+    // but a higher level may still hold an earlier one, so look at every level
+    for(int level = 0; level < levels; level++) {
+        const int current_index = (current >> (level_bits * level)) & (level_size - 1);
+
+        for(int i = 1; i <= level_size; i++) {
+            const Timer *timer = buckets[level][(current_index + i) & (level_size - 1)];
+            if(timer == nullptr) continue;
+
+            for(; timer != nullptr; timer = timer->next) {
+                next = std::min(next, timer->when);
+            }
+            break;
+        }
+    }
+
+    // Timers started after they were due run on the next msec
+    return std::max(next, current + 1);
+}
+
+int TimerWheel::size() const
+{
+    return count;
+}
+
+void TimerWheel::link(Timer *timer, Timer **slot)
+{
+    const int position = slot - &buckets[0][0];
+    occupied[position / level_size] |= uint64_t(1) << (position % level_size);
+
+    timer->slot = slot;
+    timer->prev = nullptr;
+    timer->next = *slot;
+    if(*slot != nullptr) {
+        (*slot)->prev = timer;
+    }
+    *slot = timer;
+    count++;
+}
+
+void TimerWheel::unlink(Timer *timer)
+{
+    if(timer->prev != nullptr) {
+        timer->prev->next = timer->next;
+    }else{
+        *timer->slot = timer->next;
+        if(timer->next == nullptr) {
+            const int position = timer->slot - &buckets[0][0];
+            occupied[position / level_size] &= ~(uint64_t(1) << (position % level_size));
+        }
+    }
+    if(timer->next != nullptr) {
+        timer->next->prev = timer->prev;
+    }
+
+    timer->slot = nullptr;
+    timer->prev = nullptr;
+    timer->next = nullptr;
+    count--;
+}
+
+void TimerWheel::insert(Timer *timer)
+{
+    // Timers already due run on the next msec
+    const int64_t when = timer->when > current ? timer->when : current + 1;
+    const int64_t delta = when - current;
+
+    // The slot of level n is reached when the time matches 'when' in all the bits above level n
+    for(int level = 0; level < levels - 1; level++) {
+        if(delta < (int64_t(1) << (level_bits * (level + 1)))) {
+            link(timer, &buckets[level][(when >> (level_bits * level)) & (level_size - 1)]);
+            return;
+        }
+    }
+
+    // Too far in the future, wait in the last level and get sorted again when it is reached
+    const int64_t last = delta < (int64_t(1) << (level_bits * levels)) ? when : current + (int64_t(1) << (level_bits * levels)) - 1;
+    link(timer, &buckets[levels - 1][(last >> (level_bits * (levels - 1))) & (level_size - 1)]);
+}
+
+// Move the timers of the slot of 'level' we just reached into the lower levels
+void TimerWheel::cascade(int level)
+{
+    const int index = (current >> (level_bits * level)) & (level_size - 1);
+    if(index == 0 && level + 1 < levels) {
+        cascade(level + 1);
+    }
+
+    Timer *timer = buckets[level][index];
+    buckets[level][index] = nullptr;
+    occupied[level] &= ~(uint64_t(1) << index);
+
+    while(timer != nullptr) {
+        Timer *next_timer = timer->next;
+        count--;
+
+        if(timer->when <= current) {
+            // Due right now, runs in this msec
+            link(timer, &buckets[0][current & (level_size - 1)]);
+        }else{
+            insert(timer);
+        }
+
+        timer = next_timer;
+    }
+}
+
+int64_t TimerWheel::next_slot_time() const
+{
+    int64_t next = std::numeric_limits<int64_t>::max();
+
+    for(int level = 0; level < levels; level++) {
+        if(occupied[level] == 0) continue;
+
+        // A slot of this level is reached every 64^level msec. Rotate the bits so the slot
+        // after the current one comes first, the lowest bit set is then the next one reached.
+        const int shift = level_bits * level;
+        const int start = (((current >> shift) + 1) & (level_size - 1));
+        const uint64_t rotated = start == 0 ? occupied[level] : (occupied[level] >> start) | (occupied[level] << (level_size - start));
+        const int ahead = __builtin_ctzll(rotated) + 1;
+
+        next = std::min(next, ((current >> shift) + ahead) << shift);
+    }
+
+    return next;
+}
+
+void TimerWheel::advance(int64_t time)
+{
+    while(current < time) {
+        if(count == 0) {
+            // Nothing to wait for
+            current = time;
+            break;
+        }
+
+        // Skip the msecs where nothing happens at once, after a long sleep there can be millions
+        const int64_t next = next_slot_time();
+        if(next > time) {
+            current = time;
+            break;
+        }
+        current = next;
+
+        const int index = current & (level_size - 1);
+        if(index == 0) {
+            cascade(1);
+        }
+
+        // Take the timers one at a time, the callbacks may stop the other ones in this slot
+        Timer **slot = &buckets[0][index];
+        while(*slot != nullptr) {
+            Timer *timer = *slot;
+            unlink(timer);
+            timer->wheel = nullptr;
+
+            if(timer->callback) {
+                timer->callback();
+            }
+        }
+    }
+}
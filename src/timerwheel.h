@@ -0,0 +1,101 @@
+/*
+ * Qt-ponies - ponies on the desktop
+ * Copyright (C) 2012 mysha
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TIMERWHEEL_H
+#define TIMERWHEEL_H
+
+#include <functional>
+#include <cstdint>
+
+class TimerWheel;
+
+// Callback run by a TimerWheel at a given time. Stopping or destroying the timer cancels it.
+class Timer
+{
+public:
+    explicit Timer(const std::function<void()> &callback = std::function<void()>());
+    ~Timer();
+
+    void set_callback(const std::function<void()> &callback);
+
+    // Run the callback once the wheel reaches 'time' (in msec). Restarts the timer if it is active.
+    void start(TimerWheel *wheel, int64_t time);
+    void stop();
+    bool is_active() const;
+    int64_t time() const;
+
+private:
+    friend class TimerWheel;
+
+    Timer(const Timer&) = delete;
+    Timer& operator=(const Timer&) = delete;
+
+    std::function<void()> callback;
+    TimerWheel *wheel; // nullptr when not active
+    int64_t when;
+
+    // Position in the list of a wheel slot
+    Timer **slot;
+    Timer *prev;
+    Timer *next;
+};
+
+// Hierarchical timer wheel with a resolution of 1 msec.
+// Starting and stopping a timer takes constant time, and advancing the wheel only
+// looks at the slots it passes, no matter how many timers are waiting. Timers due
+// in the next 64 msec are kept in the first level, later ones in coarser levels
+// and moved down when their time gets closer. Stretches of time where no slot holding
+// timers is reached are skipped at once.
+class TimerWheel
+{
+public:
+    explicit TimerWheel(int64_t start_time);
+    ~TimerWheel();
+
+    // Run every timer due at or before 'time'. Callbacks may start and stop timers.
+    void advance(int64_t time);
+    int64_t time() const;
+    // Earliest time a timer is due, or the largest int64_t if there is none
+    int64_t next_time() const;
+    // Number of active timers
+    int size() const;
+
+private:
+    friend class Timer;
+
+    TimerWheel(const TimerWheel&) = delete;
+    TimerWheel& operator=(const TimerWheel&) = delete;
+
+    static const int level_bits = 6;
+    static const int level_size = 1 << level_bits;
+    static const int levels = 4; // 64^4 msec, about 4.6 hours. Later timers wait in the last level.
+
+    void insert(Timer *timer);
+    void link(Timer *timer, Timer **slot);
+    void unlink(Timer *timer);
+    void cascade(int level);
+    // Earliest time after the current one at which advance() reaches a slot holding timers
+    int64_t next_slot_time() const;
+
+    Timer *buckets[levels][level_size];
+    uint64_t occupied[levels]; // Bit i is set if slot i of the level holds timers
+    int64_t current; // Every timer due at or before this time has run
+    int count;
+};
+
+#endif // TIMERWHEEL_H